@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+#include "../settings.hpp"
+
+namespace config {
+
+// Directives outside of server blocks
+class Global {
+   public:
+    Global()
+        : worker_processes(1),
+          worker_threads(1),
+          multi_accept(MULTI_ACCEPT),
+          open_file_cache(0),
+          open_file_cache_valid(OPEN_FILE_CACHE_VALID),
+          open_file_cache_errors(false),
+          response_cache_entries(0),
+          response_cache_size(RESPONSE_CACHE_SIZE),
+          cgi_splice(true),
+          cgi_output_buffer_size(CGI_OUTPUT_BUF_SIZE),
+          cgi_spawner(true),
+          fastcgi_keepalive(FASTCGI_KEEPALIVE),
+          client_body_temp_path(CLIENT_BODY_TEMP_PATH) {}
+
+    uint32_t    worker_processes;
+    uint32_t    worker_threads;
+    uint32_t    multi_accept;
+    uint32_t    open_file_cache;  // max entries per event loop, 0 disables the cache
+    uint32_t    open_file_cache_valid;
+    bool        open_file_cache_errors;
+    uint32_t    response_cache_entries;  // max entries per event loop, 0 disables the cache
+    uint64_t    response_cache_size;
+    bool        cgi_splice;  // move CGI output to the socket in the kernel where splice exists
+    uint64_t    cgi_output_buffer_size;  // CGI output held for a slow client, read again at half
+    bool        cgi_spawner;  // launch CGIs from a helper process instead of forking the server
+    uint32_t    fastcgi_keepalive;  // idle FastCGI connections kept per event loop
+    std::string client_body_temp_path;  // directory of the files large request bodies go to
+};
+
+}  // namespace config
@@ -1,6 +1,16 @@
 #include "Interpreter.hpp"
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
 #include "../core/ByteBuffer.hpp"
+#include "../core/FastCgiPool.hpp"
 #include "../settings.hpp"
 #include "../utils/get_cwd.hpp"
 #include "../utils/str_to_num.hpp"
@@ -8,7 +18,22 @@
 
 namespace config {
 
-void Interpreter::parse(const std::vector<Token> &v_token, std::vector<Server> &v_server) {
+void Interpreter::parse(const std::vector<Token> &v_token, std::vector<Server> &v_server,
+                        Global &global) {
+    bool worker_processes_set = false;
+    bool worker_threads_set = false;
+    bool multi_accept_set = false;
+    bool open_file_cache_set = false;
+    bool open_file_cache_valid_set = false;
+    bool open_file_cache_errors_set = false;
+    bool response_cache_entries_set = false;
+    bool response_cache_size_set = false;
+    bool cgi_splice_set = false;
+    bool cgi_output_buffer_size_set = false;
+    bool cgi_spawner_set = false;
+    bool fastcgi_keepalive_set = false;
+    bool client_body_temp_path_set = false;
+
     for (std::vector<Token>::const_iterator it = v_token.begin(); it != v_token.end(); ++it) {
         _last_directive = &(it->text);
         if (it->text == "server" && it->type == IDENTIFIER) {
@@ -17,6 +42,104 @@ void Interpreter::parse(const std::vector<Token> &v_token, std::vector<Server> &
                 v_server.insert(v_server.begin(), new_server);
             else
                 v_server.push_back(new_server);
+        } else if (it->text == "worker_processes" && it->type == IDENTIFIER) {
+            if (worker_processes_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_count(v_token, it, global.worker_processes, MAX_WORKERS, true);
+                worker_processes_set = true;
+            }
+        } else if (it->text == "worker_threads" && it->type == IDENTIFIER) {
+            if (worker_threads_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_count(v_token, it, global.worker_threads, MAX_WORKERS, true);
+                worker_threads_set = true;
+            }
+        } else if (it->text == "multi_accept" && it->type == IDENTIFIER) {
+            if (multi_accept_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_count(v_token, it, global.multi_accept, MAX_CONNECTIONS, false);
+                multi_accept_set = true;
+            }
+        } else if (it->text == "open_file_cache" && it->type == IDENTIFIER) {
+            if (open_file_cache_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_count(v_token, it, global.open_file_cache, MAX_OPEN_FILE_CACHE, false);
+                open_file_cache_set = true;
+            }
+        } else if (it->text == "open_file_cache_valid" && it->type == IDENTIFIER) {
+            if (open_file_cache_valid_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_count(v_token, it, global.open_file_cache_valid,
+                             MAX_OPEN_FILE_CACHE_VALID, false);
+                open_file_cache_valid_set = true;
+            }
+        } else if (it->text == "open_file_cache_errors" && it->type == IDENTIFIER) {
+            if (open_file_cache_errors_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_bool(v_token, it, global.open_file_cache_errors);
+                open_file_cache_errors_set = true;
+            }
+        } else if (it->text == "response_cache_entries" && it->type == IDENTIFIER) {
+            if (response_cache_entries_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_count(v_token, it, global.response_cache_entries,
+                             MAX_RESPONSE_CACHE_ENTRIES, false);
+                response_cache_entries_set = true;
+            }
+        } else if (it->text == "response_cache_size" && it->type == IDENTIFIER) {
+            if (response_cache_size_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_bytes(v_token, it, global.response_cache_size);
+                response_cache_size_set = true;
+            }
+        } else if (it->text == "cgi_splice" && it->type == IDENTIFIER) {
+            if (cgi_splice_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_bool(v_token, it, global.cgi_splice);
+                cgi_splice_set = true;
+            }
+        } else if (it->text == "cgi_output_buffer_size" && it->type == IDENTIFIER) {
+            if (cgi_output_buffer_size_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_bytes(v_token, it, global.cgi_output_buffer_size);
+                // At least one read from the CGI has to fit
+                if (global.cgi_output_buffer_size < CGI_BUF_SIZE) {
+                    std::vector<Token>::const_iterator it_size = it - 1;
+                    _invalid_parameter(it_size);
+                }
+                cgi_output_buffer_size_set = true;
+            }
+        } else if (it->text == "cgi_spawner" && it->type == IDENTIFIER) {
+            if (cgi_spawner_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_bool(v_token, it, global.cgi_spawner);
+                cgi_spawner_set = true;
+            }
+        } else if (it->text == "fastcgi_keepalive" && it->type == IDENTIFIER) {
+            if (fastcgi_keepalive_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_count(v_token, it, global.fastcgi_keepalive, MAX_FASTCGI_KEEPALIVE, false);
+                fastcgi_keepalive_set = true;
+            }
+        } else if (it->text == "client_body_temp_path" && it->type == IDENTIFIER) {
+            if (client_body_temp_path_set) {
+                _directive_already_set(it);
+            } else {
+                _parse_string(v_token, it, global.client_body_temp_path);
+                client_body_temp_path_set = true;
+            }
         } else {
             _invalid_directive(it);
         }
@@ -29,6 +152,7 @@ bool Interpreter::_parse_server(const std::vector<Token>           &v_token,
 
     bool is_default_server = false;
     bool client_max_size_set = false;
+    bool client_buffer_size_set = false;
 
     if (it->text == "{" && it->type == OPERATOR) {
         _increment_token(v_token, it);
@@ -51,6 +175,13 @@ bool Interpreter::_parse_server(const std::vector<Token>           &v_token,
                     _parse_bytes(v_token, it, new_server.client_max_body_size);
                     client_max_size_set = true;
                 }
+            } else if (*_last_directive == "client_body_buffer_size") {
+                if (client_buffer_size_set) {
+                    _directive_already_set(it);
+                } else {
+                    _parse_bytes(v_token, it, new_server.client_body_buffer_size);
+                    client_buffer_size_set = true;
+                }
             } else if (*_last_directive == "location") {
                 Location new_location;
                 new_location = _parse_location(v_token, it);
@@ -80,8 +211,16 @@ Location Interpreter::_parse_location(const std::vector<Token>           &v_toke
     }
 
     bool dir_listing_set = false;
+    bool delete_files_set = false;
     bool acc_methods_set = false;
     bool client_max_size_set = false;
+    bool client_buffer_size_set = false;
+    bool response_cache_set = false;
+    bool gzip_static_set = false;
+    bool gzip_set = false;
+    bool gzip_comp_level_set = false;
+    bool gzip_min_length_set = false;
+    bool expires_set = false;
 
     if (it->text == "{" && it->type == OPERATOR) {
         _increment_token(v_token, it);
@@ -110,6 +249,10 @@ Location Interpreter::_parse_location(const std::vector<Token>           &v_toke
                 CgiPass new_pass;
                 _parse_cgi_pass(v_token, it, new_pass);
                 new_location.v_cgi_pass.push_back(new_pass);
+            } else if (*_last_directive == "fastcgi_pass" || *_last_directive == "cgi_pool") {
+                CgiPass new_pass;
+                _parse_cgi_pass(v_token, it, new_pass);
+                new_location.v_cgi_pass.push_back(new_pass);
             } else if (*_last_directive == "directory_listing") {
                 if (dir_listing_set) {
                     _directive_already_set(it);
@@ -117,6 +260,13 @@ Location Interpreter::_parse_location(const std::vector<Token>           &v_toke
                     _parse_bool(v_token, it, new_location.directory_listing);
                     dir_listing_set = true;
                 }
+            } else if (*_last_directive == "delete_files") {
+                if (delete_files_set) {
+                    _directive_already_set(it);
+                } else {
+                    _parse_bool(v_token, it, new_location.delete_files);
+                    delete_files_set = true;
+                }
             } else if (*_last_directive == "client_max_body_size") {
                 if (client_max_size_set) {
                     _directive_already_set(it);
@@ -124,6 +274,81 @@ Location Interpreter::_parse_location(const std::vector<Token>           &v_toke
                     _parse_bytes(v_token, it, new_location.client_max_body_size);
                     client_max_size_set = true;
                 }
+            } else if (*_last_directive == "client_body_buffer_size") {
+                if (client_buffer_size_set) {
+                    _directive_already_set(it);
+                } else {
+                    _parse_bytes(v_token, it, new_location.client_body_buffer_size);
+                    client_buffer_size_set = true;
+                }
+            } else if (*_last_directive == "upload_store") {
+                if (new_location.upload_store.size() != 0) {
+                    _directive_already_set(it);
+                } else {
+                    _parse_string(v_token, it, new_location.upload_store);
+                    // Created once here, uploads only write into it
+                    struct stat store_stat;
+                    if ((mkdir(new_location.upload_store.c_str(), 0755) == -1 && errno != EEXIST) ||
+                        stat(new_location.upload_store.c_str(), &store_stat) == -1 ||
+                        !S_ISDIR(store_stat.st_mode) ||
+                        access(new_location.upload_store.c_str(), W_OK | X_OK) == -1) {
+                        std::vector<Token>::const_iterator it_store = it - 1;
+                        _could_not_create_dir(it_store);
+                    }
+                }
+            } else if (*_last_directive == "response_cache") {
+                if (response_cache_set) {
+                    _directive_already_set(it);
+                } else {
+                    _parse_bool(v_token, it, new_location.response_cache);
+                    response_cache_set = true;
+                }
+            } else if (*_last_directive == "gzip_static") {
+                if (gzip_static_set) {
+                    _directive_already_set(it);
+                } else {
+                    _parse_bool(v_token, it, new_location.gzip_static);
+                    gzip_static_set = true;
+                }
+            } else if (*_last_directive == "gzip") {
+                if (gzip_set) {
+                    _directive_already_set(it);
+                } else {
+                    _parse_bool(v_token, it, new_location.gzip);
+                    gzip_set = true;
+                }
+            } else if (*_last_directive == "gzip_comp_level") {
+                if (gzip_comp_level_set) {
+                    _directive_already_set(it);
+                } else {
+                    _parse_count(v_token, it, new_location.gzip_comp_level, 9, false);
+                    gzip_comp_level_set = true;
+                }
+            } else if (*_last_directive == "gzip_min_length") {
+                if (gzip_min_length_set) {
+                    _directive_already_set(it);
+                } else {
+                    _parse_bytes(v_token, it, new_location.gzip_min_length);
+                    gzip_min_length_set = true;
+                }
+            } else if (*_last_directive == "gzip_types") {
+                _parse_string(v_token, it, new_location.v_gzip_type);
+            } else if (*_last_directive == "expires") {
+                if (expires_set) {
+                    _directive_already_set(it);
+                } else {
+                    _parse_expires(v_token, it, new_location);
+                    expires_set = true;
+                }
+            } else if (*_last_directive == "cache_control") {
+                if (new_location.cache_control.size() != 0) {
+                    _directive_already_set(it);
+                } else {
+                    std::vector<std::string> v_value;
+                    _parse_string(v_token, it, v_value);
+                    for (size_t i = 0; i < v_value.size(); i++)
+                        new_location.cache_control += (i > 0 ? " " : "") + v_value[i];
+                }
             } else {
                 _invalid_directive(it);
             }
@@ -155,7 +380,8 @@ void Interpreter::_parse_string(const std::vector<Token>           &v_token,
         }
         std::string str(it->text);
         if (*_last_directive == "accepted_methods") {
-            if (!(str == "GET" || str == "POST" || str == "DELETE" || str == "HEAD")) {
+            if (!(str == "GET" || str == "POST" || str == "DELETE" || str == "HEAD" ||
+                  str == "PUT")) {
                 _wrong_method(it, str);
             }
         }
@@ -178,7 +404,8 @@ void Interpreter::_parse_string(const std::vector<Token>           &v_token,
             _unexpected_operator(it);
     }
     identifier = it->text;
-    if (*_last_directive == "root" && identifier.back() != '/')
+    if ((*_last_directive == "root" || *_last_directive == "upload_store") &&
+        identifier[identifier.size() - 1] != '/')
         identifier += '/';
     _increment_token(v_token, it);
 
@@ -202,9 +429,34 @@ void Interpreter::_parse_cgi_pass(const std::vector<Token>           &v_token,
         _invalid_directive_argument_amount(it);
     else if (it->type == OPERATOR)
         _unexpected_operator(it);
-    identifier.path = utils::get_absolute_path(it->text);
+    // fastcgi_pass takes the "unix:/path" or "host:port" of a running FastCGI server instead
+    identifier.is_fastcgi = *_last_directive == "fastcgi_pass";
+    if (!identifier.is_fastcgi)
+        identifier.path = utils::get_absolute_path(it->text);
+    else if (!core::FastCgiPool::is_valid_address(it->text))
+        _invalid_parameter(it);
+    else if (it->text.compare(0, 5, "unix:") == 0)
+        identifier.path = "unix:" + utils::get_absolute_path(it->text.substr(5));
+    else
+        identifier.path = it->text;
     _increment_token(v_token, it);
 
+    // cgi_pool adds the number of workers and optionally the requests a worker serves
+    if (*_last_directive == "cgi_pool") {
+        if (it->type != IDENTIFIER)
+            _invalid_directive_argument_amount(it);
+        if (!utils::str_to_num_dec(it->text, identifier.pool_workers) ||
+            identifier.pool_workers == 0 || identifier.pool_workers > MAX_CGI_POOL_WORKERS)
+            _invalid_parameter(it);
+        _increment_token(v_token, it);
+        if (it->type == IDENTIFIER) {
+            if (!utils::str_to_num_dec(it->text, identifier.pool_max_requests) ||
+                identifier.pool_max_requests == 0)
+                _invalid_parameter(it);
+            _increment_token(v_token, it);
+        }
+    }
+
     if (it->type == IDENTIFIER)
         _invalid_directive_argument_amount(it);
     else if (it->type == OPERATOR && it->text != ";") {
@@ -269,7 +521,7 @@ void Interpreter::_parse_error_page(const std::vector<Token>           &v_token,
                                     std::map<int, http::error_page_t>  &m_error_page) {
     _increment_token(v_token, it);
 
-    std::vector<std::uint32_t> v_code;
+    std::vector<uint32_t> v_code;
 
     for (; it != v_token.end() && it->text != ";"; ++it) {
         if (it->text.find_first_not_of("0123456789") == std::string::npos) {
@@ -291,7 +543,7 @@ void Interpreter::_parse_error_page(const std::vector<Token>           &v_token,
     }
 
     std::ifstream file;
-    file.open(it->text);
+    file.open(it->text.c_str());
     if (!file.is_open()) {
         _could_not_open_file(it);
     }
@@ -325,7 +577,7 @@ void Interpreter::_parse_redirect(const std::vector<Token>           &v_token,
     _increment_token(v_token, it);
 
     std::vector<Token>::const_iterator iter = it;
-    std::uint32_t                      count = 0;
+    uint32_t                      count = 0;
     for (; iter != v_token.end() && iter->text != ";"; ++iter) {
         if (iter->type == OPERATOR)
             _unexpected_operator(iter);
@@ -363,11 +615,11 @@ void Interpreter::_parse_redirect(const std::vector<Token>           &v_token,
 }
 
 void Interpreter::_parse_bytes(const std::vector<Token>           &v_token,
-                               std::vector<Token>::const_iterator &it, std::uint64_t &identifier) {
+                               std::vector<Token>::const_iterator &it, uint64_t &identifier) {
     _increment_token(v_token, it);
 
     std::string   num = it->text;
-    std::uint64_t multiplier;
+    uint64_t multiplier;
     char          byte_size = num[it->text.size() - 1];
 
     if (byte_size == 'G' || byte_size == 'g') {
@@ -435,6 +687,7 @@ void Interpreter::_parse_location_path(const std::vector<Token>           &v_tok
                     break;
                 } else {
                     _invalid_path(it);
+                    break;
                 }
             case SLASH:
                 if (c == '/')
@@ -516,6 +769,101 @@ void Interpreter::_parse_bool(const std::vector<Token>           &v_token,
     }
 }
 
+void Interpreter::_parse_count(const std::vector<Token>           &v_token,
+                               std::vector<Token>::const_iterator &it, uint32_t &identifier,
+                               uint32_t max_count, bool is_auto_allowed) {
+    _increment_token(v_token, it);
+
+    size_t num = 0;
+    if (it->type == OPERATOR) {
+        if (it->text == ";")
+            _invalid_directive_argument_amount(it);
+        else
+            _unexpected_operator(it);
+    } else if (it->text == "auto" && is_auto_allowed) {
+        identifier = WORKERS_AUTO;
+    } else if (utils::str_to_num_dec(it->text, num) && num > 0 && num <= max_count) {
+        identifier = num;
+    } else {
+        _invalid_parameter(it);
+    }
+    _increment_token(v_token, it);
+    if (it->type == IDENTIFIER)
+        _invalid_directive_argument_amount(it);
+    else if (it->text != ";") {
+        if (it->type == OPERATOR)
+            _unexpected_operator(it);
+        else
+            _none_terminated_directive(it);
+    }
+}
+
+// Seconds of a time unit as nginx writes them, 0 for an unknown one
+static size_t time_unit(char unit) {
+    switch (unit) {
+        case 's':
+            return 1;
+        case 'm':
+            return 60;
+        case 'h':
+            return 3600;
+        case 'd':
+            return 86400;
+        case 'w':
+            return 7 * 86400;
+        case 'M':
+            return 30 * 86400;
+        case 'y':
+            return 365 * 86400;
+        default:
+            return 0;
+    }
+}
+
+// "off", "epoch", "max" or a time like 30d, 12h or -1 with an optional unit of s, m, h, d, w, M or y
+void Interpreter::_parse_expires(const std::vector<Token>           &v_token,
+                                 std::vector<Token>::const_iterator &it, Location &location) {
+    _increment_token(v_token, it);
+
+    if (it->type == OPERATOR) {
+        if (it->text == ";")
+            _invalid_directive_argument_amount(it);
+        else
+            _unexpected_operator(it);
+    } else if (it->text == "off") {
+        location.expires = Location::EXPIRES_OFF;
+    } else if (it->text == "epoch") {
+        location.expires = Location::EXPIRES_EPOCH;
+    } else if (it->text == "max") {
+        location.expires = Location::EXPIRES_MAX;
+    } else {
+        std::string num = it->text;
+        bool        is_negative = num.size() > 0 && num[0] == '-';
+        size_t      unit = 1;
+        if (is_negative)
+            num.erase(0, 1);
+        if (num.size() > 0 && !isdigit(num[num.size() - 1])) {
+            unit = time_unit(num[num.size() - 1]);
+            num.erase(num.size() - 1);
+        }
+        size_t time = 0;
+        if (unit == 0 || num.size() == 0 || !utils::str_to_num_dec(num, time) ||
+            time > EXPIRES_MAX_TIME / unit)
+            _invalid_parameter(it);
+        location.expires = Location::EXPIRES_TIME;
+        location.expires_time = is_negative ? -(int64_t)(time * unit) : (int64_t)(time * unit);
+    }
+    _increment_token(v_token, it);
+    if (it->type == IDENTIFIER)
+        _invalid_directive_argument_amount(it);
+    else if (it->text != ";") {
+        if (it->type == OPERATOR)
+            _unexpected_operator(it);
+        else
+            _none_terminated_directive(it);
+    }
+}
+
 void Interpreter::_increment_token(const std::vector<Token>           &v_token,
                                    std::vector<Token>::const_iterator &it) {
     ++it;
@@ -635,6 +983,16 @@ void Interpreter::_could_not_open_file(std::vector<Token>::const_iterator &it) c
     exit(EXIT_FAILURE);
 }
 
+void Interpreter::_could_not_create_dir(std::vector<Token>::const_iterator &it) const {
+    int error = errno;
+    utils::print_timestamp(std::cerr);
+    std::cerr << " directory \"" << it->text << "\""
+              << " for directive \"" << *_last_directive << "\" could not be created ("
+              << (error == 0 || error == EEXIST ? "not a writable directory" : strerror(error))
+              << ") in " << _path << ":" << it->line_number << "\n";
+    exit(EXIT_FAILURE);
+}
+
 void Interpreter::_invalid_port(std::vector<Token>::const_iterator &it,
                                 const std::string                  &port_str) const {
     utils::print_timestamp(std::cerr);
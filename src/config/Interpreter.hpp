@@ -8,6 +8,7 @@
 
 #include "../core/Address.hpp"
 #include "../http/status_codes.hpp"
+#include "Global.hpp"
 #include "Server.hpp"
 #include "Token.hpp"
 
@@ -22,7 +23,7 @@ class Interpreter {
    public:
     Interpreter(const std::string &file_path) : _path(file_path) {}
 
-    void parse(const std::vector<Token> &v_token, std::vector<Server> &v_server);
+    void parse(const std::vector<Token> &v_token, std::vector<Server> &v_server, Global &global);
 
    private:
     const std::string  _path;
@@ -48,11 +49,15 @@ class Interpreter {
     void _parse_redirect(const std::vector<Token> &v_token, std::vector<Token>::const_iterator &it,
                          Redirect &identifier);
     void _parse_bytes(const std::vector<Token> &v_token, std::vector<Token>::const_iterator &it,
-                      std::uint64_t &identifier);
+                      uint64_t &identifier);
     void _parse_location_path(const std::vector<Token>           &v_token,
                               std::vector<Token>::const_iterator &it, std::string &location_path);
     void _parse_bool(const std::vector<Token> &v_token, std::vector<Token>::const_iterator &it,
                      bool &identifier);
+    void _parse_count(const std::vector<Token> &v_token, std::vector<Token>::const_iterator &it,
+                      uint32_t &identifier, uint32_t max_count, bool is_auto_allowed);
+    void _parse_expires(const std::vector<Token> &v_token, std::vector<Token>::const_iterator &it,
+                        Location &location);
 
     void _increment_token(const std::vector<Token>           &v_token,
                           std::vector<Token>::const_iterator &it);
@@ -74,6 +79,7 @@ class Interpreter {
     void _invalid_error_code(std::vector<Token>::const_iterator &it, const int32_t &code) const;
     void _duplicate_error_code(std::vector<Token>::const_iterator &it, const int32_t &code) const;
     void _could_not_open_file(std::vector<Token>::const_iterator &it) const;
+    void _could_not_create_dir(std::vector<Token>::const_iterator &it) const;
     void _invalid_port(std::vector<Token>::const_iterator &it, const std::string &port_str) const;
     void _numeric_char_expected(std::vector<Token>::const_iterator &it,
                                 const std::string                  &num) const;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 #include <iostream>
 #include <string>
 #include <vector>
@@ -10,33 +12,63 @@ namespace config {
 
 class Redirect {
    public:
-    std::uint32_t status_code;
+    uint32_t status_code;
     std::string   direction;
     std::string   origin;
 };
 
 class CgiPass {
    public:
-    std::string path;
+    CgiPass() : is_fastcgi(false), pool_workers(0), pool_max_requests(CGI_POOL_MAX_REQUESTS) {}
+
+    std::string path;  // CGI program, or FastCGI address for fastcgi_pass
     std::string type;
+    bool        is_fastcgi;
+    size_t      pool_workers;  // persistent workers of a cgi_pool, 0 starts a CGI per request
+    size_t      pool_max_requests;
 };
 
 class Location {
    public:
-    Location() : client_max_body_size(SIZE_MAX) {}
+    enum Expires { EXPIRES_OFF, EXPIRES_TIME, EXPIRES_EPOCH, EXPIRES_MAX };
+
+    Location()
+        : client_max_body_size(SIZE_MAX),
+          client_body_buffer_size(SIZE_MAX),
+          directory_listing(false),
+          delete_files(false),
+          response_cache(true),
+          gzip_static(false),
+          gzip(false),
+          gzip_comp_level(GZIP_COMP_LEVEL),
+          gzip_min_length(GZIP_MIN_LENGTH),
+          expires(EXPIRES_OFF),
+          expires_time(0) {}
     void print(std::string prefix) const;
 
     std::string              path;
     std::vector<std::string> v_accepted_method;
     std::vector<Redirect>    v_redirect;
     std::string              root;
+    std::string              upload_store;  // POST and PUT bodies are stored here natively
 
-    std::uint64_t client_max_body_size;
+    uint64_t client_max_body_size;
+    uint64_t client_body_buffer_size;  // SIZE_MAX streams the body to a CGI while it arrives
     bool          directory_listing;
+    bool          delete_files;  // DELETE unlinks the file instead of going to a CGI
+    bool          response_cache;
+    bool          gzip_static;
+    bool          gzip;
+    uint32_t      gzip_comp_level;
+    uint64_t      gzip_min_length;
+    Expires       expires;
+    int64_t       expires_time;   // seconds from now, a negative time forbids caching
+    std::string   cache_control;  // replaces the Cache-Control that expires builds
 
     std::vector<std::string> v_index;
     std::vector<Location>    v_location;
     std::vector<CgiPass>     v_cgi_pass;
+    std::vector<std::string> v_gzip_type;  // text/html is always compressed
 };
 
 }  // namespace config
\ No newline at end of file
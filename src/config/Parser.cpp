@@ -1,10 +1,14 @@
 #include "Parser.hpp"
 
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
 #include "../utils/timestamp.hpp"
 
 namespace config {
 
-void Parser::parse(const std::string &file_path, std::vector<Server> &v_server) {
+void Parser::parse(const std::string &file_path, std::vector<Server> &v_server, Global &global) {
     Tokenizer          tokenizer;
     std::string        file_content = _file_to_string(file_path);
     std::vector<Token> v_token;
@@ -12,9 +16,9 @@ void Parser::parse(const std::string &file_path, std::vector<Server> &v_server)
     tokenizer.parse(v_token, file_content);
 
     Interpreter interpreter(file_path);
-    interpreter.parse(v_token, v_server);
+    interpreter.parse(v_token, v_server, global);
 
-    _inherit_client_max_body_size(v_server);
+    _inherit_body_sizes(v_server);
 
     if (!_is_config_valid(file_path, v_server))
         exit(EXIT_FAILURE);
@@ -27,7 +31,7 @@ std::string Parser::_file_to_string(std::string file_path) {
     std::stringstream buf;
     std::string       file_content;
 
-    file.open(file_path);
+    file.open(file_path.c_str());
     if (!file.is_open()) {
         utils::print_timestamp(std::cerr);
         std::cerr << " " << strerror(errno) << ": \"" << file_path << "\"" << std::endl;
@@ -69,7 +73,8 @@ bool Parser::_is_config_valid(const std::string &file_path, const std::vector<Se
     return (true);
 }
 
-void Parser::_inherit_client_max_body_size(std::vector<Server> &v_server) {
+// A client_body_buffer_size set nowhere stays SIZE_MAX, bodies are streamed then
+void Parser::_inherit_body_sizes(std::vector<Server> &v_server) {
     for (std::vector<Server>::iterator it = v_server.begin(); it != v_server.end(); ++it) {
         if (it->client_max_body_size == SIZE_MAX)
             it->client_max_body_size = CLIENT_MAX_BODY_SIZE;
@@ -77,6 +82,8 @@ void Parser::_inherit_client_max_body_size(std::vector<Server> &v_server) {
              it2 != it->v_location.end(); ++it2) {
             if (it2->client_max_body_size == SIZE_MAX)
                 it2->client_max_body_size = it->client_max_body_size;
+            if (it2->client_body_buffer_size == SIZE_MAX)
+                it2->client_body_buffer_size = it->client_body_buffer_size;
         }
     }
 }
@@ -11,13 +11,13 @@ namespace config {
 
 class Parser {
    public:
-    void parse(const std::string &file_path, std::vector<Server> &v_server);
+    void parse(const std::string &file_path, std::vector<Server> &v_server, Global &global);
 
    private:
     std::string _file_to_string(std::string file_path);
 
     bool _is_config_valid(const std::string &file_path, const std::vector<Server> &v_server);
-    void _inherit_client_max_body_size(std::vector<Server> &v_server);
+    void _inherit_body_sizes(std::vector<Server> &v_server);
     void _check_duplicate_listen(const std::string &file_path, const std::vector<Server> &v_server);
     void _check_duplicate_cgi_pass(const std::string         &file_path,
                                    const std::vector<Server> &v_server);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 #include <iostream>
 #include <map>
 #include <string>
@@ -14,12 +16,13 @@ namespace config {
 
 class Server {
    public:
-    Server() : client_max_body_size(SIZE_MAX) {}
+    Server() : client_max_body_size(SIZE_MAX), client_body_buffer_size(SIZE_MAX) {}
     void print() const;
 
     std::vector<core::Address>        v_listen;
     std::vector<std::string>          v_server_name;
-    std::uint64_t                     client_max_body_size;
+    uint64_t                     client_max_body_size;
+    uint64_t                     client_body_buffer_size;
     std::vector<Location>             v_location;
     std::map<int, http::error_page_t> m_error_codes;
 };
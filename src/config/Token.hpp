@@ -7,8 +7,8 @@ namespace config {
 
 enum TokenType { WHITESPACE, IDENTIFIER, OPERATOR, COMMENT, ESCAPE };
 
-static const char *token_type_string[] = {"WHITESPACE", "IDENTIFIER", "OPERATOR", "COMMENT",
-                                          "ESCAPE"};
+static const char *const token_type_string[] = {"WHITESPACE", "IDENTIFIER", "OPERATOR",
+                                                "COMMENT", "ESCAPE"};
 
 class Token {
    public:
@@ -11,10 +11,8 @@ ByteBuffer::~ByteBuffer() {}
 void ByteBuffer::append(const char *str, std::size_t n) {
     if (str == NULL)
         return;
-    if (n + size() > capacity()) {
-        erase(begin(), begin() + _pos);
-        _pos = 0;
-    }
+    if (n + size() > capacity())
+        compact();
     insert(end(), str, str + n);
 }
 
@@ -24,10 +22,8 @@ void ByteBuffer::append(const char *str) {
     size_t i = 0;
     while (str[i])
         i++;
-    if (i + size() > capacity()) {
-        erase(begin(), begin() + _pos);
-        _pos = 0;
-    }
+    if (i + size() > capacity())
+        compact();
     insert(end(), str, str + i);
 }
 
@@ -40,6 +36,16 @@ bool ByteBuffer::equal(ByteBuffer::iterator pos, const char *str, std::size_t n)
     return i == n;
 }
 
+// Drops the bytes before the position, so a buffer consumed from the front reuses its memory
+void ByteBuffer::compact() {
+    if (_pos >= size()) {
+        clear();
+    } else if (_pos > 0) {
+        erase(begin(), begin() + _pos);
+    }
+    _pos = 0;
+}
+
 size_t ByteBuffer::pos() const { return _pos; }
 
 void ByteBuffer::set_pos(size_t new_pos) { _pos = new_pos; }
@@ -49,7 +55,7 @@ ByteBuffer &ByteBuffer::operator+=(const ByteBuffer &buf) {
     return *this;
 }
 
-ByteBuffer &ByteBuffer::operator+=(std::uint8_t c) {
+ByteBuffer &ByteBuffer::operator+=(uint8_t c) {
     push_back(c);
     return *this;
 }
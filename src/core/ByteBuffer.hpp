@@ -1,11 +1,13 @@
 #pragma once
 
+#include <stdint.h>
+
 #include <iostream>
 #include <vector>
 
 namespace core {
 
-class ByteBuffer : public std::vector<std::uint8_t> {
+class ByteBuffer : public std::vector<uint8_t> {
    private:
     size_t _pos;
 
@@ -18,12 +20,13 @@ class ByteBuffer : public std::vector<std::uint8_t> {
     void append(const char *str);
     void append(ByteBuffer *str);
     bool equal(ByteBuffer::iterator pos, const char *str, std::size_t n);
+    void compact();
 
     size_t pos() const;
     void   set_pos(size_t new_pos);
 
     ByteBuffer &operator+=(const ByteBuffer &buf);
-    ByteBuffer &operator+=(std::uint8_t c);
+    ByteBuffer &operator+=(uint8_t c);
 
     friend std::ostream &operator<<(std::ostream &os, const ByteBuffer &bb);
 };
@@ -1,16 +1,45 @@
 #include "CgiHandler.hpp"
 
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+
 #include "../http/status_codes.hpp"
 
 namespace core {
 
-CgiHandler::CgiHandler(const http::Request &request, http::Response &response)
-    : _request(request), _response(response), _read_fd(-1), _write_fd(-1), _is_done(true) {
+static void free_split(char **split) {
+    for (int i = 0; split[i]; ++i)
+        delete[] split[i];
+    delete[] split;
+}
+
+CgiHandler::CgiHandler(http::Request &request, http::Response &response)
+    : _request(request),
+      _response(response),
+      _read_fd(-1),
+      _write_fd(-1),
+      _is_done(true),
+      _is_splicing(false),
+      _is_hung_up(false),
+      _is_read_paused(false),
+      _output_buffer_size(CGI_OUTPUT_BUF_SIZE),
+      _cgi_spawner(NULL),
+      _fastcgi_pool(NULL),
+      _is_fastcgi(false),
+      _is_stdin_done(false),
+      _cgi_pool(NULL),
+      _pool_pass(NULL) {
     _buf = new char[CGI_BUF_SIZE];
 }
 
 CgiHandler::~CgiHandler() {
-    if (_read_fd != -1)
+    // The socket of a pooled worker is closed by the pool
+    if (_read_fd != -1 && !_pool_pass)
         close(_read_fd);
     if (_write_fd != -1)
         close(_write_fd);
@@ -43,10 +72,9 @@ void CgiHandler::execute(EventNotificationInterface &eni, const std::string &cgi
         throw HTTP_INTERNAL_SERVER_ERROR;
     }
 
-    _is_done = false;
-    _pid = fork();
-
-    if (_pid == -1) {
+    // A body spooled to a temp file is read by the CGI from the file itself
+    int body_fd = _request.body_fd();
+    if (body_fd != -1 && lseek(body_fd, 0, SEEK_SET) == -1) {
         close(read_fd[0]);
         close(read_fd[1]);
         close(write_fd[0]);
@@ -55,36 +83,172 @@ void CgiHandler::execute(EventNotificationInterface &eni, const std::string &cgi
         throw HTTP_INTERNAL_SERVER_ERROR;
     }
 
-    if (_pid == 0) {
-        close(write_fd[1]);
-        close(read_fd[0]);
-        dup2(write_fd[0], STDIN_FILENO);
-        close(write_fd[0]);
-        dup2(read_fd[1], STDOUT_FILENO);
-        close(read_fd[1]);
-        _run_program(cgi_path, script_path);
-    } else {
-        _read_fd = read_fd[0];
-        _write_fd = write_fd[1];
-        close(read_fd[1]);
-        close(write_fd[0]);
+    // The spawner launches the CGI without the event loop copying the page tables of the whole
+    // server, forking is left for when it is not running or busy
+    _is_done = false;
+    int stdin_fd = body_fd != -1 ? body_fd : write_fd[0];
+    std::vector<std::string> v_argv;
+    v_argv.push_back(cgi_path);
+    v_argv.push_back(script_path);
+    if (!_cgi_spawner || !_cgi_spawner->spawn(v_argv, _request.location()->root,
+                                              _request.m_header(), stdin_fd, read_fd[1])) {
+        // Built before forking, the child of a multi-threaded process must not allocate
+        std::map<std::string, std::string> m_header(_request.m_header());
+        char                             **env = _get_env(m_header);
+        char                             **argv = _get_argv(cgi_path, script_path);
 
-        eni.add_event(_read_fd, EVFILT_READ);
-        eni.add_cgi_fd(_read_fd, this);
-        if (!_request.body().empty()) {
-            eni.add_event(_write_fd, EVFILT_WRITE);
-            eni.add_cgi_fd(_write_fd, this);
-        } else {
-            close(_write_fd);
-            _write_fd = -1;
+        _pid = fork();
+
+        if (_pid != 0) {
+            free_split(env);
+            free_split(argv);
+        }
+        if (_pid == -1) {
+            close(read_fd[0]);
+            close(read_fd[1]);
+            close(write_fd[0]);
+            close(write_fd[1]);
+            reset(eni);
+            throw HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        if (_pid == 0) {
+            close(write_fd[1]);
+            close(read_fd[0]);
+            dup2(stdin_fd, STDIN_FILENO);
+            close(write_fd[0]);
+            dup2(read_fd[1], STDOUT_FILENO);
+            close(read_fd[1]);
+            _run_program(cgi_path, env, argv);
         }
     }
+
+    _read_fd = read_fd[0];
+    _write_fd = write_fd[1];
+    close(read_fd[1]);
+    close(write_fd[0]);
+    fcntl(_read_fd, F_SETFL, O_NONBLOCK);
+    fcntl(_write_fd, F_SETFL, O_NONBLOCK);
+
+    eni.add_event(_read_fd, EVFILT_READ);
+    eni.add_cgi_fd(_read_fd, this);
+    if (_request.has_body() && body_fd == -1) {
+        eni.add_event(_write_fd, EVFILT_WRITE);
+        eni.add_cgi_fd(_write_fd, this);
+    } else {
+        close(_write_fd);
+        _write_fd = -1;
+    }
+}
+
+// The FastCGI connection is read and written through two fds of the same socket, so both
+// directions are handled like the pipes of a CGI program
+void CgiHandler::execute_fastcgi(EventNotificationInterface &eni, const std::string &address) {
+    reset(eni);
+
+    int body_fd = _request.body_fd();
+    if (!_fastcgi_pool || (body_fd != -1 && lseek(body_fd, 0, SEEK_SET) == -1))
+        throw HTTP_INTERNAL_SERVER_ERROR;
+    int fd = _fastcgi_pool->acquire(address);
+    int write_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (write_fd == -1) {
+        close(fd);
+        throw HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    _fastcgi_address = address;
+    _is_fastcgi = true;
+    _is_done = false;
+    _start_fastcgi(eni, fd, write_fd);
+}
+
+// Pooled workers take the request as FastCGI records on their stdin. Without an idle worker the
+// request waits in line and is started by the pool once a worker is free.
+void CgiHandler::execute_pool(EventNotificationInterface &eni, const config::CgiPass &pass) {
+    reset(eni);
+
+    int body_fd = _request.body_fd();
+    if (!_cgi_pool || (body_fd != -1 && lseek(body_fd, 0, SEEK_SET) == -1))
+        throw HTTP_INTERNAL_SERVER_ERROR;
+    int fd = _cgi_pool->acquire(pass, this);
+    _pool_pass = &pass;
+    _is_fastcgi = true;
+    _is_done = false;
+    if (fd != -1)
+        start_pooled(eni, fd);
+}
+
+void CgiHandler::start_pooled(EventNotificationInterface &eni, int fd) {
+    int write_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (write_fd == -1) {
+        const config::CgiPass *pass = _pool_pass;
+        _pool_pass = NULL;
+        _cgi_pool->release(eni, *pass, fd, false);
+        eof_read(eni);
+        return;
+    }
+    _start_fastcgi(eni, fd, write_fd);
+}
+
+// The request waited for a worker that can no longer be started, it is answered like a request
+// that found no worker at all
+void CgiHandler::fail_pooled(EventNotificationInterface &eni) {
+    _pool_pass = NULL;
+    reset(eni);
+    _response.init();
+    _response.build_error(_request, HTTP_BAD_GATEWAY);
+    eni.enable_event(_connection_fd, EVFILT_WRITE);
+    eni.add_timer(_connection_fd, CONN_TIMEOUT_TIME);
+}
+
+void CgiHandler::_start_fastcgi(EventNotificationInterface &eni, int fd, int write_fd) {
+    _fastcgi_stream.init();
+    _fastcgi_out.clear();
+    _fastcgi_out.set_pos(0);
+    _is_stdin_done = false;
+    FastCgiStream::append_begin_request(_fastcgi_out);
+    FastCgiStream::append_params(_fastcgi_out, _request.m_header());
+    if (!_request.has_body()) {
+        FastCgiStream::append_stdin(_fastcgi_out, NULL, 0);
+        _is_stdin_done = true;
+    }
+
+    _read_fd = fd;
+    _write_fd = write_fd;
+    eni.add_event(_read_fd, EVFILT_READ);
+    eni.add_cgi_fd(_read_fd, this);
+    eni.add_event(_write_fd, EVFILT_WRITE);
+    eni.add_cgi_fd(_write_fd, this);
 }
 
 void CgiHandler::reset(EventNotificationInterface &eni) {
     _is_done = true;
+    _is_splicing = false;
+    _is_hung_up = false;
+    _is_read_paused = false;
+    _is_fastcgi = false;
+    _fastcgi_address.clear();
     _pid = -1;
-    _body_pos = 0;
+    // A worker whose request broke off is replaced, the socket may hold half of its response
+    if (_pool_pass) {
+        const config::CgiPass *pass = _pool_pass;
+        _pool_pass = NULL;
+        if (_write_fd != -1) {
+            eni.delete_event(_write_fd, EVFILT_WRITE);
+            eni.remove_cgi_fd(_write_fd);
+            close(_write_fd);
+            _write_fd = -1;
+        }
+        if (_read_fd != -1) {
+            eni.delete_event(_read_fd, EVFILT_READ);
+            eni.remove_cgi_fd(_read_fd);
+            int fd = _read_fd;
+            _read_fd = -1;
+            _cgi_pool->release(eni, *pass, fd, false);
+        } else {
+            _cgi_pool->cancel(*pass, this);
+        }
+    }
     if (_read_fd != -1) {
         eni.delete_event(_read_fd, EVFILT_READ);
         eni.remove_cgi_fd(_read_fd);
@@ -100,74 +264,303 @@ void CgiHandler::reset(EventNotificationInterface &eni) {
 }
 
 void CgiHandler::eof_read(EventNotificationInterface &eni) {
+    // A paused CGI may have ended with output left, it is read once the client caught up
+    if (_is_read_paused && _read_fd != -1 && !_is_splicing) {
+        _is_hung_up = true;
+        eni.delete_event(_read_fd, EVFILT_READ);
+        return;
+    }
+    // A spliced pipe reports the hang up while the output written last may still be in it, the
+    // connection moves it out and ends the response once it finds the pipe empty
+    int ready_len = 0;
+    if (_is_splicing && ioctl(_read_fd, FIONREAD, &ready_len) == 0 && ready_len > 0) {
+        _is_hung_up = true;
+        eni.delete_event(_read_fd, EVFILT_READ);
+        eni.enable_event(_connection_fd, EVFILT_WRITE);
+        eni.add_timer(_connection_fd, CONN_TIMEOUT_TIME);
+        return;
+    }
     reset(eni);
     eni.enable_event(_connection_fd, EVFILT_WRITE);
     eni.add_timer(_connection_fd, CONN_TIMEOUT_TIME);
 }
 
 void CgiHandler::read(EventNotificationInterface &eni, size_t data_len) {
+    if (_is_fastcgi) {
+        _read_fastcgi(eni, data_len);
+        return;
+    }
+
+    // The connection splices the output itself, it only has to be woken up. The pipe may have
+    // been emptied by the connection since the event was polled, so an empty pipe only counts as
+    // the end of the output once the CGI closed it.
+    if (_is_splicing) {
+        int ready_len = 0;
+        if (ioctl(_read_fd, FIONREAD, &ready_len) == -1) {
+            reset(eni);
+            throw std::runtime_error("Error reading from CGI");
+        }
+        if (ready_len == 0) {
+            struct pollfd pipe_poll = {_read_fd, POLLIN, 0};
+            if (poll(&pipe_poll, 1, 0) == 1 && pipe_poll.revents == POLLHUP)
+                eof_read(eni);
+            return;
+        }
+        eni.disable_event(_read_fd, EVFILT_READ);
+        eni.enable_event(_connection_fd, EVFILT_WRITE);
+        eni.add_timer(_connection_fd, CONN_TIMEOUT_TIME);
+        return;
+    }
+
     size_t to_read_len = data_len < CGI_BUF_SIZE ? data_len : CGI_BUF_SIZE;
     int    read_len = ::read(_read_fd, _buf, to_read_len);
     if (read_len == -1) {
         reset(eni);
         throw std::runtime_error("Error reading from CGI");
     }
+    if (read_len == 0) {
+        eof_read(eni);
+        return;
+    }
     _response.body().append(_buf, read_len);
+    _limit_output(eni);
     eni.enable_event(_connection_fd, EVFILT_WRITE);
     eni.add_timer(_connection_fd, CONN_TIMEOUT_TIME);
 }
 
+// Output the client did not take yet is held up to the buffer size, then the CGI is not read
+// until half of it is sent
+void CgiHandler::_limit_output(EventNotificationInterface &eni) {
+    ByteBuffer &body = _response.body();
+    if (body.size() - body.pos() < _output_buffer_size)
+        return;
+    eni.disable_event(_read_fd, EVFILT_READ);
+    _is_read_paused = true;
+}
+
+void CgiHandler::output_sent(EventNotificationInterface &eni, size_t unsent_len) {
+    if (!_is_read_paused || unsent_len >= _output_buffer_size / 2)
+        return;
+    _is_read_paused = false;
+    if (_read_fd == -1 || _is_splicing)
+        return;
+    if (_is_hung_up)
+        eni.add_event(_read_fd, EVFILT_READ);
+    else
+        eni.enable_event(_read_fd, EVFILT_READ);
+}
+
+// The rest of the body is dropped, the connection keeps reading it if the CGI stopped early
 void CgiHandler::eof_write(EventNotificationInterface &eni) {
     eni.delete_event(_write_fd, EVFILT_WRITE);
     eni.remove_cgi_fd(_write_fd);
     close(_write_fd);
     _write_fd = -1;
+    _request.body().clear();
+    _request.body().set_pos(0);
+    if (!_request.is_done())
+        eni.enable_event(_connection_fd, EVFILT_READ);
 }
 
+// Body bytes are taken from the front of the request body, which only holds what arrived since
 void CgiHandler::write(EventNotificationInterface &eni, std::size_t max_size) {
-    std::size_t left_bytes;
-    std::size_t send_bytes;
+    if (_is_fastcgi) {
+        _write_fastcgi(eni, max_size);
+        return;
+    }
 
-    left_bytes = _request.body().size() - _body_pos;
-    if (left_bytes > max_size)
-        send_bytes = max_size;
+    core::ByteBuffer &body = _request.body();
+    size_t            left_len = body.size() - body.pos();
+    size_t            to_write_len = left_len < max_size ? left_len : max_size;
+
+    if (to_write_len > 0) {
+        ssize_t written = ::write(_write_fd, &body[body.pos()], to_write_len);
+        if (written == -1) {
+            eof_write(eni);
+            return;
+        }
+        body.set_pos(body.pos() + written);
+    }
+    if (body.size() - body.pos() < CGI_BODY_BUF_SIZE && !_request.is_done()) {
+        eni.enable_event(_connection_fd, EVFILT_READ);
+        eni.add_timer(_connection_fd, CONN_TIMEOUT_TIME);
+    }
+    if (body.pos() < body.size())
+        return;
+    body.clear();
+    body.set_pos(0);
+    if (_request.is_done())
+        eof_write(eni);
     else
-        send_bytes = left_bytes;
-    ::write(_write_fd, &(_request.body()[_body_pos]), send_bytes);
-    _body_pos += send_bytes;
-    left_bytes = _request.body().size() - _body_pos;
-    if (left_bytes == 0) {
-        eni.delete_event(_write_fd, EVFILT_WRITE);
-        eni.remove_cgi_fd(_write_fd);
-        close(_write_fd);
-        _write_fd = -1;
+        eni.disable_event(_write_fd, EVFILT_WRITE);
+}
+
+// Called whenever the connection parsed more of the body. The socket is not read while the CGI
+// has a full buffer of it left to take. FastCGI also has to be woken up for the end of the body.
+void CgiHandler::body_received(EventNotificationInterface &eni) {
+    core::ByteBuffer &body = _request.body();
+    size_t            left_len = body.size() - body.pos();
+
+    if (is_queued()) {
+        if (left_len >= CGI_BODY_BUF_SIZE && !_request.is_done())
+            eni.disable_event(_connection_fd, EVFILT_READ);
+        return;
     }
+    if (_write_fd == -1) {
+        body.clear();
+        body.set_pos(0);
+        return;
+    }
+    if (left_len == 0 && _request.is_done() && !_is_fastcgi) {
+        eof_write(eni);
+        return;
+    }
+    if (left_len > 0 || _is_fastcgi)
+        eni.enable_event(_write_fd, EVFILT_WRITE);
+    else
+        eni.disable_event(_write_fd, EVFILT_WRITE);
+    if (left_len >= CGI_BODY_BUF_SIZE && !_request.is_done())
+        eni.disable_event(_connection_fd, EVFILT_READ);
 }
 
-bool CgiHandler::is_done() const { return _is_done; }
+// Request records are framed from the body as it arrives, the next slice is only taken once the
+// records before it are written
+void CgiHandler::_write_fastcgi(EventNotificationInterface &eni, std::size_t max_size) {
+    core::ByteBuffer &body = _request.body();
 
-int32_t CgiHandler::get_read_fd() const { return _read_fd; }
+    if (_fastcgi_out.pos() >= _fastcgi_out.size() && !_is_stdin_done) {
+        _fastcgi_out.clear();
+        _fastcgi_out.set_pos(0);
+        size_t left_len = body.size() - body.pos();
+        if (_request.body_fd() != -1) {
+            ssize_t read_len = ::read(_request.body_fd(), _buf, CGI_BUF_SIZE);
+            if (read_len == -1) {
+                reset(eni);
+                throw std::runtime_error("Error reading request body");
+            }
+            FastCgiStream::append_stdin(_fastcgi_out, reinterpret_cast<uint8_t *>(_buf),
+                                        read_len);
+            _is_stdin_done = read_len == 0;
+        } else if (left_len > 0) {
+            size_t len = left_len < max_size ? left_len : max_size;
+            FastCgiStream::append_stdin(_fastcgi_out, &body[body.pos()], len);
+            body.set_pos(body.pos() + len);
+            if (body.size() - body.pos() < CGI_BODY_BUF_SIZE && !_request.is_done()) {
+                eni.enable_event(_connection_fd, EVFILT_READ);
+                eni.add_timer(_connection_fd, CONN_TIMEOUT_TIME);
+            }
+            if (body.pos() >= body.size()) {
+                body.clear();
+                body.set_pos(0);
+                if (_request.is_done()) {
+                    FastCgiStream::append_stdin(_fastcgi_out, NULL, 0);
+                    _is_stdin_done = true;
+                }
+            }
+        } else if (_request.is_done() || !_request.has_body()) {
+            FastCgiStream::append_stdin(_fastcgi_out, NULL, 0);
+            _is_stdin_done = true;
+        } else {
+            eni.disable_event(_write_fd, EVFILT_WRITE);
+            return;
+        }
+    }
 
-int32_t CgiHandler::get_write_fd() const { return _write_fd; }
+    size_t  left_len = _fastcgi_out.size() - _fastcgi_out.pos();
+    ssize_t written = ::write(_write_fd, &_fastcgi_out[_fastcgi_out.pos()],
+                              left_len < max_size ? left_len : max_size);
+    if (written == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            eof_write(eni);
+        return;
+    }
+    _fastcgi_out.set_pos(_fastcgi_out.pos() + written);
+    if (_fastcgi_out.pos() >= _fastcgi_out.size() && _is_stdin_done)
+        eof_write(eni);
+}
 
-static void free_split(char **split) {
-    for (int i = 0; split[i]; ++i)
-        free(split[i]);
-    free(split);
+void CgiHandler::_read_fastcgi(EventNotificationInterface &eni, size_t data_len) {
+    size_t  to_read_len = data_len < CGI_BUF_SIZE ? data_len : CGI_BUF_SIZE;
+    ssize_t read_len = ::read(_read_fd, _buf, to_read_len);
+    if (read_len == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return;
+        reset(eni);
+        throw std::runtime_error("Error reading from FastCGI");
+    }
+    if (read_len == 0) {
+        eof_read(eni);
+        return;
+    }
+    size_t parsed_len = _fastcgi_stream.parse(reinterpret_cast<uint8_t *>(_buf), read_len,
+                                              _response.body());
+    if (_fastcgi_stream.is_ended()) {
+        _end_fastcgi(eni, parsed_len == (size_t)read_len);
+        return;
+    }
+    _limit_output(eni);
+    eni.enable_event(_connection_fd, EVFILT_WRITE);
+    eni.add_timer(_connection_fd, CONN_TIMEOUT_TIME);
+}
+
+// The connection goes back to the pool only if the whole request was written and nothing
+// follows the end of the response
+void CgiHandler::_end_fastcgi(EventNotificationInterface &eni, bool is_clean) {
+    bool is_reusable = is_clean && _is_stdin_done && _write_fd == -1;
+
+    eni.delete_event(_read_fd, EVFILT_READ);
+    eni.remove_cgi_fd(_read_fd);
+    int fd = _read_fd;
+    _read_fd = -1;
+    if (_pool_pass) {
+        const config::CgiPass *pass = _pool_pass;
+        _pool_pass = NULL;
+        _cgi_pool->release(eni, *pass, fd, is_reusable);
+    } else if (is_reusable) {
+        _fastcgi_pool->release(_fastcgi_address, fd);
+    } else {
+        close(fd);
+    }
+    eof_read(eni);
 }
 
-void CgiHandler::_run_program(const std::string &cgi_path, const std::string &script_path) {
-    std::map<std::string, std::string> m_header(_request.m_header());
+void CgiHandler::set_splicing(bool is_splicing) { _is_splicing = is_splicing; }
 
-    char **env = _get_env(m_header);
-    char **argv = _get_argv(cgi_path, script_path);
+void CgiHandler::set_cgi_spawner(const CgiSpawner *cgi_spawner) { _cgi_spawner = cgi_spawner; }
 
-    chdir(_request.location()->root.c_str());
+void CgiHandler::set_fastcgi_pool(FastCgiPool *fastcgi_pool) { _fastcgi_pool = fastcgi_pool; }
+
+void CgiHandler::set_cgi_pool(CgiPool *cgi_pool) { _cgi_pool = cgi_pool; }
+
+void CgiHandler::set_output_buffer_size(size_t output_buffer_size) {
+    _output_buffer_size = output_buffer_size;
+}
+
+bool CgiHandler::is_done() const { return _is_done; }
+
+bool CgiHandler::is_fastcgi() const { return _is_fastcgi; }
+
+bool CgiHandler::is_queued() const { return _pool_pass && _read_fd == -1 && !_is_done; }
+
+bool CgiHandler::is_splicing() const { return _is_splicing; }
+
+bool CgiHandler::is_hung_up() const { return _is_hung_up; }
+
+bool CgiHandler::is_read_paused() const { return _is_read_paused; }
+
+int32_t CgiHandler::get_read_fd() const { return _read_fd; }
+
+int32_t CgiHandler::get_write_fd() const { return _write_fd; }
+
+void CgiHandler::_run_program(const std::string &cgi_path, char **env, char **argv) {
+    signal(SIGPIPE, SIG_DFL);
+    if (chdir(_request.location()->root.c_str()) == -1) {
+        perror("chdir");
+        _exit(EXIT_FAILURE);
+    }
     execve(cgi_path.c_str(), argv, env);
     perror("execve");
-    free_split(env);
-    free_split(argv);
-    exit(EXIT_FAILURE);
+    _exit(EXIT_FAILURE);
 }
 
 char **CgiHandler::_get_env(std::map<std::string, std::string> &env) {
@@ -10,7 +10,11 @@
 #include "../http/Request.hpp"
 #include "../http/Response.hpp"
 #include "ByteBuffer.hpp"
+#include "CgiPool.hpp"
+#include "CgiSpawner.hpp"
 #include "EventNotificationInterface.hpp"
+#include "FastCgiPool.hpp"
+#include "FastCgiStream.hpp"
 
 namespace core {
 
@@ -18,42 +22,77 @@ class EventNotificationInterface;
 
 class CgiHandler {
    private:
-    const http::Request &_request;
-    http::Response      &_response;
+    http::Request  &_request;
+    http::Response &_response;
 
     int    _read_fd;
     int    _write_fd;
     int    _connection_fd;
     pid_t  _pid;
     bool   _is_done;
-    size_t _body_pos;
+    bool   _is_splicing;
+    bool   _is_hung_up;
+    bool   _is_read_paused;  // the client lags behind, the CGI waits with its output meanwhile
+    size_t _output_buffer_size;
     char  *_buf;
 
-    void   _run_program(const std::string &cgi_path, const std::string &script_path);
+    const CgiSpawner *_cgi_spawner;
+
+    FastCgiPool  *_fastcgi_pool;
+    std::string   _fastcgi_address;
+    bool          _is_fastcgi;  // FastCGI server or pooled worker, no CGI program of its own
+    FastCgiStream _fastcgi_stream;
+    ByteBuffer    _fastcgi_out;  // request records not written yet
+    bool          _is_stdin_done;
+
+    CgiPool               *_cgi_pool;
+    const config::CgiPass *_pool_pass;  // set while a pooled worker is used or waited for
+
+    void   _limit_output(EventNotificationInterface &eni);
+    void   _start_fastcgi(EventNotificationInterface &eni, int fd, int write_fd);
+    void   _read_fastcgi(EventNotificationInterface &eni, size_t data_len);
+    void   _write_fastcgi(EventNotificationInterface &eni, std::size_t max_size);
+    void   _end_fastcgi(EventNotificationInterface &eni, bool is_clean);
+    void   _run_program(const std::string &cgi_path, char **env, char **argv);
     char **_get_env(std::map<std::string, std::string> &env);
     void   _update_env(std::map<std::string, std::string> &env);
     char **_get_argv(const std::string &path, const std::string &body);
 
    public:
-    CgiHandler(const http::Request &request, http::Response &response);
+    CgiHandler(http::Request &request, http::Response &response);
     ~CgiHandler();
 
     void init(int connection_fd);
     void execute(EventNotificationInterface &eni, const std::string &cgi_path,
                  const std::string &script_path);
+    void execute_fastcgi(EventNotificationInterface &eni, const std::string &address);
+    void execute_pool(EventNotificationInterface &eni, const config::CgiPass &pass);
+    void start_pooled(EventNotificationInterface &eni, int fd);
+    void fail_pooled(EventNotificationInterface &eni);
     void reset(EventNotificationInterface &eni);
     void stop(EventNotificationInterface &eni);
     void eof_read(EventNotificationInterface &eni);
     void read(EventNotificationInterface &eni, size_t data_len);
     void eof_write(EventNotificationInterface &eni);
     void write(EventNotificationInterface &eni, std::size_t max_size);
+    void body_received(EventNotificationInterface &eni);
+    void output_sent(EventNotificationInterface &eni, size_t unsent_len);
+
+    void set_splicing(bool is_splicing);
+    void set_cgi_spawner(const CgiSpawner *cgi_spawner);
+    void set_fastcgi_pool(FastCgiPool *fastcgi_pool);
+    void set_cgi_pool(CgiPool *cgi_pool);
+    void set_output_buffer_size(size_t output_buffer_size);
 
     bool is_done() const;
+    bool is_fastcgi() const;
+    bool is_queued() const;
+    bool is_splicing() const;
+    bool is_hung_up() const;
+    bool is_read_paused() const;
 
     int get_read_fd() const;
     int get_write_fd() const;
 };
 
-extern std::map<int, CgiHandler *> g_executor;
-
 }  // namespace core
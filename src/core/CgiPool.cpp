@@ -0,0 +1,239 @@
+#include "CgiPool.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+
+#include "../http/status_codes.hpp"
+#include "../settings.hpp"
+#include "../utils/color.hpp"
+#include "../utils/get_cwd.hpp"
+#include "CgiHandler.hpp"
+
+namespace core {
+
+CgiPool::CgiPool() : _cgi_spawner(NULL), _next_log(0) {}
+
+// Workers see the end of their stdin and exit
+CgiPool::~CgiPool() {
+    for (map_t::iterator it = _m_pool.begin(); it != _m_pool.end(); ++it) {
+        for (size_t i = 0; i < it->second.v_worker.size(); i++) {
+            if (it->second.v_worker[i].fd != -1)
+                close(it->second.v_worker[i].fd);
+        }
+    }
+}
+
+void CgiPool::set_cgi_spawner(const CgiSpawner *cgi_spawner) { _cgi_spawner = cgi_spawner; }
+
+// Starts the workers of a location up front
+void CgiPool::add(const config::CgiPass &pass, const std::string &dir) {
+    if (_m_pool.find(&pass) != _m_pool.end())
+        return;
+    Pool &pool = _m_pool[&pass];
+    pool.pass = &pass;
+    pool.dir = utils::get_absolute_path(dir);
+    pool.num_busy = 0;
+    pool.max_busy = 0;
+    pool.max_waiting = 0;
+    pool.num_requests = 0;
+    pool.num_queued = 0;
+    pool.num_replaced = 0;
+    pool.v_worker.resize(pass.pool_workers);
+    for (size_t i = 0; i < pool.v_worker.size(); i++)
+        _start_worker(pool, pool.v_worker[i]);
+}
+
+// Returns the socket of an idle worker, or -1 once the handler waits in line for one
+int CgiPool::acquire(const config::CgiPass &pass, CgiHandler *handler) {
+    map_t::iterator it = _m_pool.find(&pass);
+    if (it == _m_pool.end())
+        throw HTTP_INTERNAL_SERVER_ERROR;
+    Pool &pool = it->second;
+
+    int64_t now = _now_ms();
+    if (now >= _next_log)
+        _log(now);
+    pool.num_requests++;
+    Worker *worker = _idle_worker(pool);
+    if (worker) {
+        _take(pool, *worker);
+        return worker->fd;
+    }
+    if (pool.num_busy == 0)
+        throw HTTP_BAD_GATEWAY;
+    pool.d_waiting.push_back(handler);
+    pool.num_queued++;
+    pool.max_waiting = std::max(pool.max_waiting, pool.d_waiting.size());
+    return -1;
+}
+
+// A worker that served its requests or whose request broke off is replaced, the free workers go
+// to the requests that waited longest
+void CgiPool::release(EventNotificationInterface &eni, const config::CgiPass &pass, int fd,
+                      bool is_reusable) {
+    map_t::iterator it = _m_pool.find(&pass);
+    Worker         *worker = NULL;
+    if (it != _m_pool.end()) {
+        for (size_t i = 0; i < it->second.v_worker.size() && !worker; i++) {
+            if (it->second.v_worker[i].fd == fd && it->second.v_worker[i].is_busy)
+                worker = &it->second.v_worker[i];
+        }
+    }
+    if (!worker) {
+        close(fd);
+        return;
+    }
+    Pool &pool = it->second;
+    worker->is_busy = false;
+    pool.num_busy--;
+    if (!is_reusable || worker->num_requests >= pool.pass->pool_max_requests) {
+        close(worker->fd);
+        worker->fd = -1;
+        pool.num_replaced++;
+        _start_worker(pool, *worker);
+    }
+    _serve_waiting(eni, pool);
+}
+
+void CgiPool::cancel(const config::CgiPass &pass, CgiHandler *handler) {
+    map_t::iterator it = _m_pool.find(&pass);
+    if (it == _m_pool.end())
+        return;
+    std::deque<CgiHandler *>          &d_waiting = it->second.d_waiting;
+    std::deque<CgiHandler *>::iterator it_waiting =
+        std::find(d_waiting.begin(), d_waiting.end(), handler);
+    if (it_waiting != d_waiting.end())
+        d_waiting.erase(it_waiting);
+}
+
+// An idle worker, one that exited or could not be started before is started again
+CgiPool::Worker *CgiPool::_idle_worker(Pool &pool) {
+    for (size_t i = 0; i < pool.v_worker.size(); i++) {
+        Worker &worker = pool.v_worker[i];
+        if (worker.is_busy)
+            continue;
+        if (worker.fd != -1 && !_is_alive(worker.fd)) {
+            close(worker.fd);
+            worker.fd = -1;
+            pool.num_replaced++;
+        }
+        if (worker.fd == -1 && !_start_worker(pool, worker))
+            continue;
+        return &worker;
+    }
+    return NULL;
+}
+
+void CgiPool::_take(Pool &pool, Worker &worker) {
+    worker.is_busy = true;
+    worker.num_requests++;
+    pool.num_busy++;
+    pool.max_busy = std::max(pool.max_busy, pool.num_busy);
+}
+
+// Waiting requests go to idle workers in order. Without a busy worker none would ever be released
+// to the rest of the line, so those requests fail like a request that finds no worker at all.
+void CgiPool::_serve_waiting(EventNotificationInterface &eni, Pool &pool) {
+    while (!pool.d_waiting.empty()) {
+        Worker *worker = _idle_worker(pool);
+        if (!worker)
+            break;
+        CgiHandler *handler = pool.d_waiting.front();
+        pool.d_waiting.pop_front();
+        _take(pool, *worker);
+        handler->start_pooled(eni, worker->fd);
+    }
+    while (!pool.d_waiting.empty() && pool.num_busy == 0) {
+        CgiHandler *handler = pool.d_waiting.front();
+        pool.d_waiting.pop_front();
+        handler->fail_pooled(eni);
+    }
+}
+
+// The worker gets one end of a socket pair as stdin and stdout. Started through the spawner if it
+// runs, forked otherwise.
+bool CgiPool::_start_worker(Pool &pool, Worker &worker) {
+    int v_fd[2];
+
+    worker.fd = -1;
+    worker.num_requests = 0;
+    worker.is_busy = false;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, v_fd) == -1)
+        return false;
+    fcntl(v_fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(v_fd[0], F_SETFL, O_NONBLOCK);
+
+    std::vector<std::string>           v_argv(1, pool.pass->path);
+    std::map<std::string, std::string> m_env;
+    if (!_cgi_spawner || !_cgi_spawner->spawn(v_argv, pool.dir, m_env, v_fd[1], v_fd[1])) {
+        // Built before forking, the child of a multi-threaded process must not allocate
+        char *argv[] = {const_cast<char *>(pool.pass->path.c_str()), NULL};
+        char *env[] = {NULL};
+
+        pid_t pid = fork();
+        if (pid == -1) {
+            close(v_fd[0]);
+            close(v_fd[1]);
+            return false;
+        }
+        if (pid == 0) {
+            signal(SIGPIPE, SIG_DFL);
+            dup2(v_fd[1], STDIN_FILENO);
+            dup2(v_fd[1], STDOUT_FILENO);
+            close(v_fd[1]);
+            if (chdir(pool.dir.c_str()) == -1) {
+                perror("chdir");
+                _exit(EXIT_FAILURE);
+            }
+            execve(argv[0], argv, env);
+            perror("execve");
+            _exit(EXIT_FAILURE);
+        }
+    }
+    close(v_fd[1]);
+    worker.fd = v_fd[0];
+    return true;
+}
+
+// An idle worker has nothing to say, it either waits for a request or has exited
+bool CgiPool::_is_alive(int fd) {
+    char byte;
+    return recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == -1 &&
+           (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// Reports how many workers were busy and how many requests waited at most since the last report
+void CgiPool::_log(int64_t now) {
+    _next_log = now + CGI_POOL_LOG_TIME;
+    for (map_t::iterator it = _m_pool.begin(); it != _m_pool.end(); ++it) {
+        Pool &pool = it->second;
+#if PRINT_LEVEL > 0
+        if (pool.num_requests > 0)
+            std::cout << utils::COLOR_CY << "[CgiPool]: " << utils::COLOR_NO << pool.pass->path
+                      << ": " << pool.num_busy << "/" << pool.v_worker.size() << " busy (max "
+                      << pool.max_busy << "), " << pool.d_waiting.size() << " waiting (max "
+                      << pool.max_waiting << "), " << pool.num_requests << " requests, "
+                      << pool.num_queued << " queued, " << pool.num_replaced << " replaced"
+                      << std::endl;
+#endif
+        pool.max_busy = pool.num_busy;
+        pool.max_waiting = pool.d_waiting.size();
+    }
+}
+
+int64_t CgiPool::_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+}  // namespace core
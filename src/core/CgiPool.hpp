@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../config/Location.hpp"
+#include "CgiSpawner.hpp"
+
+namespace core {
+
+class CgiHandler;
+class EventNotificationInterface;
+
+// Persistent CGI workers of the cgi_pool locations of one event loop. A worker is started once
+// with a socket as stdin and stdout and takes one request after the other as FastCGI records.
+// Requests wait in line while every worker is busy, a worker is replaced after its maximum
+// number of requests or when a request did not end cleanly.
+class CgiPool {
+   private:
+    struct Worker {
+        int    fd;
+        size_t num_requests;
+        bool   is_busy;
+    };
+
+    struct Pool {
+        const config::CgiPass   *pass;
+        std::string              dir;  // absolute, the root of the location
+        std::vector<Worker>      v_worker;
+        std::deque<CgiHandler *> d_waiting;
+        size_t                   num_busy;
+        size_t                   max_busy;  // since the last report
+        size_t                   max_waiting;
+        uint64_t                 num_requests;
+        uint64_t                 num_queued;
+        uint64_t                 num_replaced;
+    };
+
+    typedef std::map<const config::CgiPass *, Pool> map_t;
+
+    map_t             _m_pool;
+    const CgiSpawner *_cgi_spawner;
+    int64_t           _next_log;
+
+    Worker        *_idle_worker(Pool &pool);
+    void           _take(Pool &pool, Worker &worker);
+    void           _serve_waiting(EventNotificationInterface &eni, Pool &pool);
+    bool           _start_worker(Pool &pool, Worker &worker);
+    static bool    _is_alive(int fd);
+    void           _log(int64_t now);
+    static int64_t _now_ms();
+
+    CgiPool(const CgiPool &other);
+    CgiPool &operator=(const CgiPool &other);
+
+   public:
+    CgiPool();
+    ~CgiPool();
+
+    void set_cgi_spawner(const CgiSpawner *cgi_spawner);
+    void add(const config::CgiPass &pass, const std::string &dir);
+    int  acquire(const config::CgiPass &pass, CgiHandler *handler);
+    void release(EventNotificationInterface &eni, const config::CgiPass &pass, int fd,
+                 bool is_reusable);
+    void cancel(const config::CgiPass &pass, CgiHandler *handler);
+};
+
+}  // namespace core
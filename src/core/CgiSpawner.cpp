@@ -0,0 +1,232 @@
+#include "CgiSpawner.hpp"
+
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "../settings.hpp"
+#include "../utils/get_cwd.hpp"
+#include "../utils/num_to_str.hpp"
+#include "../utils/str_to_num.hpp"
+#include "../utils/timestamp.hpp"
+
+// posix_spawn changes the directory of the child itself since glibc 2.29
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+#define SPAWN_HAS_ADDCHDIR 1
+#else
+#define SPAWN_HAS_ADDCHDIR 0
+#endif
+
+namespace core {
+
+CgiSpawner::CgiSpawner() : _fd(-1), _pid(-1) {}
+
+CgiSpawner::~CgiSpawner() {
+    if (_fd != -1)
+        close(_fd);
+}
+
+// Without a spawner every CGI is forked from the server itself, so a failure is only logged
+void CgiSpawner::start() {
+    int v_fd[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, v_fd) == -1) {
+        std::cerr << "[";
+        utils::print_timestamp(std::cerr);
+        std::cerr << "]: cgi_spawner: socketpair: " << strerror(errno) << '\n';
+        return;
+    }
+    _pid = fork();
+    if (_pid == -1) {
+        close(v_fd[0]);
+        close(v_fd[1]);
+        std::cerr << "[";
+        utils::print_timestamp(std::cerr);
+        std::cerr << "]: cgi_spawner: fork: " << strerror(errno) << '\n';
+        return;
+    }
+    if (_pid == 0) {
+        close(v_fd[0]);
+        _run(v_fd[1]);
+    }
+    close(v_fd[1]);
+    _fd = v_fd[0];
+    fcntl(_fd, F_SETFD, FD_CLOEXEC);
+}
+
+// The pipe ends travel as SCM_RIGHTS, the server may close its copies right after the send. A
+// spawner that is gone or busy makes the caller fork the CGI itself.
+bool CgiSpawner::spawn(const std::vector<std::string> &v_argv, const std::string &dir,
+                       const std::map<std::string, std::string> &m_env, int in_fd,
+                       int out_fd) const {
+    typedef std::map<std::string, std::string>::const_iterator env_it_t;
+
+    if (_fd == -1 || v_argv.empty())
+        return false;
+    std::string msg;
+    msg.append(utils::num_to_str_dec(v_argv.size())).push_back('\0');
+    // The spawner is shared by all locations, a relative root would depend on its last CGI
+    msg.append(utils::get_absolute_path(dir).c_str()).push_back('\0');
+    for (size_t i = 0; i < v_argv.size(); i++)
+        msg.append(v_argv[i].c_str()).push_back('\0');
+    for (env_it_t it = m_env.begin(); it != m_env.end(); ++it) {
+        msg.append(it->first.c_str()).push_back('=');
+        msg.append(it->second.c_str()).push_back('\0');
+    }
+    if (msg.size() > CGI_SPAWN_MSG_SIZE)
+        return false;
+
+    union {
+        struct cmsghdr align;
+        char           buf[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    std::memset(&control, 0, sizeof(control));
+    struct iovec iov;
+    iov.iov_base = &msg[0];
+    iov.iov_len = msg.size();
+    struct msghdr hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control.buf;
+    hdr.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    int v_fd[2] = {in_fd, out_fd};
+    std::memcpy(CMSG_DATA(cmsg), v_fd, sizeof(v_fd));
+
+    return sendmsg(_fd, &hdr, MSG_DONTWAIT) != -1;
+}
+
+bool CgiSpawner::is_running() const { return _fd != -1; }
+
+// Exits once every process of the server closed its end of the socket
+void CgiSpawner::_run(int fd) {
+#if defined(__linux__)
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+    // CGIs are reaped by the kernel, posix_spawn sets them back to the default
+    signal(SIGCHLD, SIG_IGN);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    std::vector<char> buf(CGI_SPAWN_MSG_SIZE + 1);
+    while (true) {
+        union {
+            struct cmsghdr align;
+            char           buf[CMSG_SPACE(2 * sizeof(int))];
+        } control;
+        struct iovec iov;
+        iov.iov_base = &buf[0];
+        iov.iov_len = CGI_SPAWN_MSG_SIZE;
+        struct msghdr hdr;
+        std::memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = control.buf;
+        hdr.msg_controllen = sizeof(control.buf);
+
+        ssize_t msg_len = recvmsg(fd, &hdr, 0);
+        if (msg_len == -1 && errno == EINTR)
+            continue;
+        if (msg_len <= 0)
+            _exit(EXIT_SUCCESS);
+
+        int             v_fd[2] = {-1, -1};
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int)))
+            std::memcpy(v_fd, CMSG_DATA(cmsg), sizeof(v_fd));
+        if (v_fd[0] != -1 && !(hdr.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+            _spawn(&buf[0], msg_len, v_fd[0], v_fd[1]);
+        for (int i = 0; i < 2; i++) {
+            if (v_fd[i] != -1)
+                close(v_fd[i]);
+        }
+    }
+}
+
+// The message holds the number of arguments, the directory to run in, the arguments and the
+// environment, each terminated by a NUL
+void CgiSpawner::_spawn(char *msg, size_t msg_len, int in_fd, int out_fd) {
+    std::vector<char *> v_str;
+    size_t              argc = 0;
+
+    msg[msg_len] = '\0';
+    for (size_t pos = 0; pos < msg_len; pos += std::strlen(msg + pos) + 1)
+        v_str.push_back(msg + pos);
+    if (v_str.size() < 3 || !utils::str_to_num_dec(v_str[0], argc) || argc == 0 ||
+        argc > v_str.size() - 2)
+        return;
+    std::vector<char *> v_argv(v_str.begin() + 2, v_str.begin() + 2 + argc);
+    v_argv.push_back(NULL);
+    v_str.push_back(NULL);
+    char *dir = v_str[1];
+    char **env = &v_str[2 + argc];
+
+#if !SPAWN_HAS_ADDCHDIR
+    // The directory is changed in the child only, the spawner itself stays where it started
+    pid_t child = fork();
+    if (child == -1)
+        perror("fork");
+    if (child != 0)
+        return;
+    signal(SIGPIPE, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    dup2(in_fd, STDIN_FILENO);
+    dup2(out_fd, STDOUT_FILENO);
+    if (in_fd > STDOUT_FILENO)
+        close(in_fd);
+    if (out_fd > STDOUT_FILENO && out_fd != in_fd)
+        close(out_fd);
+    if (chdir(dir) == -1) {
+        perror("chdir");
+        _exit(EXIT_FAILURE);
+    }
+    execve(v_argv[0], &v_argv[0], env);
+    perror("execve");
+    _exit(EXIT_FAILURE);
+#else
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, in_fd);
+    if (out_fd != in_fd)
+        posix_spawn_file_actions_addclose(&actions, out_fd);
+    // A directory that cannot be entered fails the spawn instead of running the CGI elsewhere
+    posix_spawn_file_actions_addchdir_np(&actions, dir);
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t sigdefault;
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGPIPE);
+    sigaddset(&sigdefault, SIGCHLD);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    int   error = posix_spawn(&pid, v_argv[0], &actions, &attr, &v_argv[0], env);
+    if (error) {
+        errno = error;
+        perror("posix_spawn");
+    }
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+#endif
+}
+
+}  // namespace core
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace core {
+
+// Small helper process forked at startup, before the event loops allocate their buffers and
+// caches. CGIs are launched by it with posix_spawn instead of forking the whole server, the
+// event loops only send it a message with the program, its environment and the fds it gets as
+// stdin and stdout. The spawner is the parent of every CGI and reaps them.
+class CgiSpawner {
+   private:
+    int   _fd;
+    pid_t _pid;
+
+    static void _run(int fd);
+    static void _spawn(char *msg, size_t msg_len, int in_fd, int out_fd);
+
+    CgiSpawner(const CgiSpawner &other);
+    CgiSpawner &operator=(const CgiSpawner &other);
+
+   public:
+    CgiSpawner();
+    ~CgiSpawner();
+
+    void start();
+    bool spawn(const std::vector<std::string> &v_argv, const std::string &dir,
+               const std::map<std::string, std::string> &m_env, int in_fd, int out_fd) const;
+
+    bool is_running() const;
+};
+
+}  // namespace core
@@ -1,5 +1,15 @@
 #include "Connection.hpp"
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#endif
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
 #include "../http/status_codes.hpp"
 #include "../utils/addr_to_str.hpp"
 #include "../utils/color.hpp"
@@ -49,22 +59,73 @@ Connection::Connection()
       _buf_pos(0),
       _buf_filled(0),
       _cgi_handler(_request, _response),
+      _unsent(0),
+      _is_splice_configured(false),
+      _is_splice_enabled(false),
+      _splice_left(0),
       BUF_SIZE(CONNECTION_BUF_SIZE) {
     _buf = new char[BUF_SIZE];
 }
 
+Connection::Connection(const Connection& other)
+    : _fd(-1),
+      _buf_pos(0),
+      _buf_filled(0),
+      _cgi_handler(_request, _response),
+      _unsent(0),
+      _is_splice_configured(other._is_splice_configured),
+      _is_splice_enabled(other._is_splice_configured),
+      _splice_left(0),
+      BUF_SIZE(other.BUF_SIZE) {
+    _buf = new char[BUF_SIZE];
+}
+
 Connection::~Connection() { delete[] _buf; }
 
 bool Connection::is_active() const { return _is_active; }
 
 bool Connection::is_request_done() const { return _is_request_done; }
 
-bool Connection::is_response_done() const { return _response.state() == http::Response::DONE; }
+bool Connection::is_header_done() const { return _request.is_header_done(); }
+
+bool Connection::is_response_done() const {
+    return _response.state() == http::Response::DONE && _unsent.empty();
+}
 
 bool Connection::should_close() const { return _should_close; }
 
 int Connection::fd() const { return _fd; }
 
+void Connection::set_caches(OpenFileCache* open_file_cache, ResponseCache* response_cache,
+                            ResponseCache* listing_cache) {
+    _response.file_handler().set_cache(open_file_cache);
+    _response.set_response_cache(response_cache);
+    _response.set_listing_cache(listing_cache);
+}
+
+void Connection::set_cgi_splice(bool is_enabled) {
+    _is_splice_configured = is_enabled;
+    _is_splice_enabled = is_enabled;
+}
+
+void Connection::set_cgi_spawner(const CgiSpawner* cgi_spawner) {
+    _cgi_handler.set_cgi_spawner(cgi_spawner);
+}
+
+void Connection::set_fastcgi_pool(FastCgiPool* fastcgi_pool) {
+    _cgi_handler.set_fastcgi_pool(fastcgi_pool);
+}
+
+void Connection::set_cgi_pool(CgiPool* cgi_pool) { _cgi_handler.set_cgi_pool(cgi_pool); }
+
+void Connection::set_cgi_output_buffer_size(size_t size) {
+    _cgi_handler.set_output_buffer_size(size);
+}
+
+void Connection::set_client_body_temp_path(const std::string& path) {
+    _request.set_body_temp_path(path);
+}
+
 void Connection::init(int fd, Address client_addr, Address socket_addr) {
     _fd = fd;
     _buf_pos = 0;
@@ -74,10 +135,18 @@ void Connection::init(int fd, Address client_addr, Address socket_addr) {
     _should_close = false;
     _is_active = false;
     _is_request_done = false;
+    _is_response_built = false;
     _request_error = 0;
     _request.init();
     _response.init();
     _cgi_handler.init(_fd);
+    _upload_handler.abort();
+    _unsent.clear();
+    _unsent.set_pos(0);
+    _splice_left = 0;
+    // A socket refusing spliced data does not turn it off for the next one, later requests on
+    // the same socket keep it off
+    _is_splice_enabled = _is_splice_configured;
 
 #if PRINT_LEVEL > 0
     std::cout << utils::COLOR_BL << "[Accepted]: " << utils::COLOR_NO
@@ -91,23 +160,30 @@ void Connection::reinit() {
     _should_close = false;
     _is_active = false;
     _is_request_done = false;
+    _is_response_built = false;
     _request_error = 0;
     _request.init();
     _response.init();
     _cgi_handler.init(_fd);
+    _upload_handler.abort();
+    _unsent.clear();
+    _unsent.set_pos(0);
+    _splice_left = 0;
 }
 
-void Connection::receive(size_t data_len) {
+size_t Connection::receive(size_t data_len) {
     _buf_pos = 0;
-    size_t to_recv_len = data_len < BUF_SIZE ? data_len : BUF_SIZE;
-    _buf_filled = recv(_fd, _buf, to_recv_len, 0);
-    if (_buf_filled != to_recv_len) {
+    size_t  to_recv_len = data_len < BUF_SIZE ? data_len : BUF_SIZE;
+    ssize_t recv_len = recv(_fd, _buf, to_recv_len, 0);
+    if (recv_len == -1) {
         throw std::runtime_error("recv: failed");
     }
+    _buf_filled = recv_len;
 #if PRINT_LEVEL > 2
     std::cout << utils::COLOR_BL << "[Received]: " << utils::COLOR_NO
               << utils::num_to_str_dec(_buf_filled) << " bytes" << std::endl;
 #endif
+    return _buf_filled;
 }
 
 void Connection::parse_request(const std::vector<config::Server>& v_server) {
@@ -127,25 +203,51 @@ void Connection::parse_request(const std::vector<config::Server>& v_server) {
     }
 }
 
+// Called once the header is parsed and again for every part of the body. A CGI or an upload store
+// is started right away and takes the body while it arrives, any other response does not need the
+// body. Buffered bodies are read completely before the response starts.
 void Connection::build_response(EventNotificationInterface& eni) {
+    if (!_is_request_done && _request.is_body_buffered())
+        return;
+    if (_is_response_built && _request_error) {
+        // The body turned out to be invalid after the response was started
+        _cgi_handler.reset(eni);
+        _upload_handler.abort();
+        if (_response.state() != http::Response::HEADER &&
+            (_response.state() != http::Response::HEADER_CGI || _response.body().pos() != 0))
+            throw std::runtime_error("request body: invalid");
+        _response.init();
+    } else if (_is_response_built) {
+        _continue_body(eni);
+        return;
+    }
+    _is_response_built = true;
+
     if (!_request_error) {
         try {
             _response.build(_request);
-            if (_response.need_cgi() || _response.is_dir_listing()) {
+            if (_response.is_upload())
+                _upload_handler.start(_request);
+            if (_response.need_cgi()) {
                 _build_cgi_env();
-                if (_response.is_dir_listing()) {
-                    _cgi_handler.execute(eni, utils::get_absolute_path(DIR_LISTING_CGI_PATH),
-                                         utils::get_absolute_path(DIR_LISTING_CGI_SCRIPT_PATH));
-                } else {
+                if (_response.cgi_pass()->is_fastcgi)
+                    _cgi_handler.execute_fastcgi(eni, _response.cgi_pass()->path);
+                else if (_response.cgi_pass()->pool_workers > 0)
+                    _cgi_handler.execute_pool(eni, *_response.cgi_pass());
+                else
                     _cgi_handler.execute(eni, _response.cgi_pass()->path,
                                          _response.cgi_script_relative_path());
-                }
             }
         } catch (int error) {
             if (error == HTTP_NOT_FOUND || error == HTTP_FORBIDDEN)
                 _should_close = false;
             else
                 _should_close = true;
+            // A rejected upload is answered right away, the rest of its body is not read
+            if (_response.is_upload() && !_is_request_done) {
+                _is_request_done = true;
+                _should_close = true;
+            }
             _response.init();
             _response.build_error(_request, error);
         }
@@ -159,6 +261,39 @@ void Connection::build_response(EventNotificationInterface& eni) {
 #if PRINT_LEVEL > 1
     _response.print();
 #endif
+    _continue_body(eni);
+}
+
+void Connection::_continue_body(EventNotificationInterface& eni) {
+    if (_response.is_upload()) {
+        _continue_upload();
+    } else if (_cgi_handler.get_write_fd() != -1 || _cgi_handler.is_queued()) {
+        _cgi_handler.body_received(eni);
+    } else {
+        _request.body().clear();
+        _request.body().set_pos(0);
+    }
+}
+
+// The upload is answered once the body is complete, a failed upload right away
+void Connection::_continue_upload() {
+    try {
+        _upload_handler.write(_request.body());
+        if (!_is_request_done)
+            return;
+        _upload_handler.finish();
+        int status_code = HTTP_OK;
+        if (_request.method() == http::Request::PUT)
+            status_code = _upload_handler.is_created() ? HTTP_CREATED : HTTP_NO_CONTENT;
+        _response.build_upload(_request, status_code, _upload_handler.v_stored());
+    } catch (int error) {
+        _upload_handler.abort();
+        _request_error = error;
+        _is_request_done = true;
+        _should_close = true;
+        _response.init();
+        _response.build_error(_request, error);
+    }
 }
 
 bool Connection::send_response(EventNotificationInterface& eni, const size_t max_len) {
@@ -167,51 +302,51 @@ bool Connection::send_response(EventNotificationInterface& eni, const size_t max
     size_t sent_len;
     size_t pos;
 
-    if (_response.state() == http::Response::HEADER) {
-        pos = _response.header().pos();
-        left_len = _response.header().size() - pos;
+    if (!_unsent.empty()) {
+        pos = _unsent.pos();
+        left_len = _unsent.size() - pos;
+        to_send_len = left_len < max_len ? left_len : max_len;
+        sent_len = send(_fd, &_unsent[pos], to_send_len, 0);
+        if (sent_len == (size_t)-1)
+            throw std::runtime_error("send: failed");
+        _unsent.set_pos(pos + sent_len);
+        if (_unsent.pos() >= _unsent.size()) {
+            _unsent.clear();
+            _unsent.set_pos(0);
+        }
+        if (_response.body_type() == http::Response::BODY_CGI)
+            _resume_cgi(eni);
+        return true;
+    }
+
+    // Header and body of a cached response are in one buffer shared with the cache
+    if (_response.body_type() == http::Response::BODY_CACHED) {
+        core::SharedBuffer& prebuilt = _response.prebuilt();
+        pos = prebuilt.pos();
+        left_len = prebuilt.size() - pos;
         to_send_len = left_len < max_len ? left_len : max_len;
-        sent_len = send(_fd, &(_response.header()[pos]), to_send_len, 0);
-        if (sent_len != to_send_len)
+        sent_len = send(_fd, prebuilt.data() + pos, to_send_len, 0);
+        if (sent_len == (size_t)-1)
             throw std::runtime_error("send: failed");
         pos += sent_len;
-        _response.header().set_pos(pos);
-        if (pos >= _response.header().size()) {
-            if (_response.body_type() == http::Response::BODY_NONE) {
-                _response.set_state(http::Response::DONE);
-                _is_active = false;
-            } else if (_response.body_type() == http::Response::BODY_CGI) {
-                _response.set_state(http::Response::HEADER_CGI);
-            } else {
-                _response.set_state(http::Response::BODY);
-            }
+        prebuilt.set_pos(pos);
+        if (pos >= prebuilt.size()) {
+            _response.set_state(http::Response::DONE);
+            _is_active = false;
         }
         return true;
     }
 
-    if (_response.state() == http::Response::HEADER_CGI) {
-        char needle_1[] = "\r\n\r\n";
-        char needle_2[] = "\n\n";
+    if (_response.state() == http::Response::HEADER)
+        return _send_header(eni, max_len);
 
+    if (_response.state() == http::Response::HEADER_CGI) {
         pos = _response.body().pos();
-        core::ByteBuffer::const_iterator start_needle_1 =
-            std::search(_response.body().begin() + pos, _response.body().end(), needle_1,
-                        needle_1 + sizeof(needle_1) - 1);
-        core::ByteBuffer::const_iterator start_needle_2 =
-            std::search(_response.body().begin() + pos, _response.body().end(), needle_2,
-                        needle_2 + sizeof(needle_2) - 1);
-
-        core::ByteBuffer::const_iterator cgi_header_end = _response.body().end();
-        bool                             found_needle = false;
-        if (start_needle_1 < start_needle_2) {
-            cgi_header_end = start_needle_1 + sizeof(needle_1) - 1;
-            found_needle = true;
-        } else if (start_needle_2 < start_needle_1) {
-            cgi_header_end = start_needle_2 + sizeof(needle_2) - 1;
-            found_needle = true;
-        }
-
-        if (!found_needle) {
+        left_len = _cgi_header_len();
+        // A header the output buffer cannot hold counts as no header
+        if (left_len == 0 && _cgi_handler.is_read_paused())
+            _cgi_handler.reset(eni);
+        if (left_len == 0) {
             if (_cgi_handler.is_done()) {
                 _response.set_state(http::Response::DONE);
                 _is_active = false;
@@ -223,16 +358,15 @@ bool Connection::send_response(EventNotificationInterface& eni, const size_t max
             return false;
         }
 
-        left_len = cgi_header_end - (_response.body().begin() + pos);
         to_send_len = left_len < max_len ? left_len : max_len;
         sent_len = send(_fd, &(_response.body()[pos]), to_send_len, 0);
-        if (sent_len != to_send_len)
+        if (sent_len == (size_t)-1)
             throw std::runtime_error("send: failed");
-        pos += sent_len;
-        _response.body().set_pos(pos);
+        _response.body().set_pos(pos + sent_len);
+        _resume_cgi(eni);
         if (sent_len == left_len)
             _response.set_state(http::Response::BODY);
-        if (pos >= _response.body().size()) {
+        if (_response.body().pos() >= _response.body().size()) {
             if (!_cgi_handler.is_done()) {
                 eni.disable_event(_fd, EVFILT_WRITE);
                 eni.delete_event(_fd, EVFILT_TIMER);
@@ -249,7 +383,7 @@ bool Connection::send_response(EventNotificationInterface& eni, const size_t max
                 left_len = _response.body().size() - pos;
                 to_send_len = left_len < max_len ? left_len : max_len;
                 sent_len = send(_fd, &(_response.body()[pos]), to_send_len, 0);
-                if (sent_len != to_send_len)
+                if (sent_len == (size_t)-1)
                     throw std::runtime_error("send: failed");
                 pos += sent_len;
                 _response.body().set_pos(pos);
@@ -260,6 +394,8 @@ bool Connection::send_response(EventNotificationInterface& eni, const size_t max
                 return true;
             }
             case http::Response::BODY_CGI: {
+                if (_cgi_handler.is_splicing())
+                    return _splice_cgi(eni, max_len);
                 if (max_len < _max_pipe_size_str.size() + 4)  // size() + \r\n\r\n
                     return true;
                 size_t max_chunk_cont_len = max_len - _max_pipe_size_str.size() - 4;
@@ -267,44 +403,61 @@ bool Connection::send_response(EventNotificationInterface& eni, const size_t max
                 left_len = _response.body().size() - pos;
                 to_send_len = left_len < max_chunk_cont_len ? left_len : max_chunk_cont_len;
                 if (to_send_len > 0) {
-                    std::string chunk;
-                    chunk.reserve(to_send_len + _max_pipe_size_str.size() + 4);
-                    utils::num_to_str_hex(to_send_len, chunk);
-                    chunk += "\r\n";
-                    chunk.insert(chunk.end(), _response.body().begin() + pos,
-                                 _response.body().begin() + pos + to_send_len);
-                    chunk += "\r\n";
-                    if (send(_fd, chunk.c_str(), chunk.size(), 0) != (ssize_t)chunk.size())
-                        throw std::runtime_error("send: failed");
-                    pos += to_send_len;
-                    _response.body().set_pos(pos);
-                    if (pos >= _response.body().size()) {
-                        if (!_cgi_handler.is_done()) {
+                    _send_chunk(&_response.body()[pos], to_send_len, false);
+                    _response.body().set_pos(pos + to_send_len);
+                    _resume_cgi(eni);
+                    if (_response.body().pos() >= _response.body().size()) {
+                        if (!_cgi_handler.is_done() && _unsent.empty() && _start_splice())
+                            return true;
+                        if (!_cgi_handler.is_done() && _unsent.empty()) {
                             eni.disable_event(_fd, EVFILT_WRITE);
                             eni.delete_event(_fd, EVFILT_TIMER);
                         }
                         return false;
                     }
                 } else if (_cgi_handler.is_done()) {
-                    if (send(_fd, "0\r\n\r\n", 5, 0) != 5)
-                        throw std::runtime_error("send: failed");
+                    if (_response.gzip_encoder().is_active())
+                        _send_chunk(NULL, 0, true);
+                    _send("0\r\n\r\n", 5);
                     _response.set_state(http::Response::DONE);
                     _is_active = false;
                 }
                 return true;
             }
-            case http::Response::BODY_FILE:
-                to_send_len = _response.file_handler().read(max_len);
-                if (to_send_len > 0) {
-                    if (send(_fd, _response.file_handler().buf(), to_send_len, 0) !=
-                        (ssize_t)to_send_len)
-                        throw std::runtime_error("send: failed");
+            case http::Response::BODY_FILE: {
+                core::FileHandler &file_handler = _response.file_handler();
+                core::ByteBuffer  &body = _response.body();
+                // Part header in front of the next range of a multipart response
+                if (body.pos() < body.size()) {
+                    _send(reinterpret_cast<const char*>(&body[body.pos()]),
+                          body.size() - body.pos());
+                    body.set_pos(body.size());
+                    return true;
+                }
+                if (file_handler.send_to(_fd) == -1) {
+                    to_send_len = file_handler.read(max_len);
+                    if (to_send_len > 0)
+                        _send(file_handler.buf(), to_send_len);
                 }
-                if (_response.file_handler().left_size() == 0) {
+                if (file_handler.left_size() == 0 && !_response.next_range_part()) {
                     _response.set_state(http::Response::DONE);
                     _is_active = false;
                 }
                 return true;
+            }
+            case http::Response::BODY_LISTING: {
+                core::ByteBuffer& body = _response.body();
+                if (body.pos() < body.size()) {
+                    _send_chunk(&body[body.pos()], body.size() - body.pos(), false);
+                    body.set_pos(body.size());
+                } else if (!_response.render_listing()) {
+                    _send("0\r\n\r\n", 5);
+                    _response.set_state(http::Response::DONE);
+                    _is_active = false;
+                }
+                return true;
+            }
+            case http::Response::BODY_CACHED:
             case http::Response::BODY_NONE:
                 _response.set_state(http::Response::DONE);
                 _is_active = false;
@@ -314,10 +467,319 @@ bool Connection::send_response(EventNotificationInterface& eni, const size_t max
     return true;
 }
 
+// Sent CGI output is dropped from the buffer once it outweighs the rest, so each byte is moved at
+// most once on average. The CGI is read again once the client took most of what was held for it.
+void Connection::_resume_cgi(EventNotificationInterface& eni) {
+    core::ByteBuffer& body = _response.body();
+    if (body.pos() >= body.size() - body.pos())
+        body.compact();
+    _cgi_handler.output_sent(eni, body.size() - body.pos() + _unsent.size() - _unsent.pos());
+}
+
+// Length of the header block the CGI wrote in front of its body, 0 while it is incomplete
+size_t Connection::_cgi_header_len() {
+    char needle_1[] = "\r\n\r\n";
+    char needle_2[] = "\n\n";
+
+    core::ByteBuffer&          body = _response.body();
+    core::ByteBuffer::iterator start = body.begin() + body.pos();
+    core::ByteBuffer::iterator start_needle_1 =
+        std::search(start, body.end(), needle_1, needle_1 + sizeof(needle_1) - 1);
+    core::ByteBuffer::iterator start_needle_2 =
+        std::search(start, body.end(), needle_2, needle_2 + sizeof(needle_2) - 1);
+
+    if (start_needle_1 < start_needle_2)
+        return start_needle_1 + sizeof(needle_1) - 1 - start;
+    if (start_needle_2 < start_needle_1)
+        return start_needle_2 + sizeof(needle_2) - 1 - start;
+    return 0;
+}
+
+// Sends the header together with the part of the body that is ready in a single writev, so small
+// responses leave in one syscall and one wakeup. What the socket does not take is kept in _unsent,
+// except for buffered bodies which simply resume from their position.
+bool Connection::_send_header(EventNotificationInterface& eni, size_t max_len) {
+    core::ByteBuffer& header = _response.header();
+    core::ByteBuffer& body = _response.body();
+    struct iovec      iov[5];
+    int               iov_cnt = 0;
+    bool              is_body_buffer = false;
+    bool              is_cgi_end = false;
+    std::string       chunk_head;
+    core::ByteBuffer  compressed(0);
+    size_t            body_len;
+    size_t            cgi_header_len = 0;
+
+    if (_response.body_type() == http::Response::BODY_CGI) {
+        cgi_header_len = _cgi_header_len();
+        // A header the output buffer cannot hold counts as no header
+        if (cgi_header_len == 0 && _cgi_handler.is_read_paused())
+            _cgi_handler.reset(eni);
+        if (cgi_header_len == 0 && !_cgi_handler.is_done()) {
+            // Nothing to send before the CGI has written its header
+            eni.disable_event(_fd, EVFILT_WRITE);
+            eni.delete_event(_fd, EVFILT_TIMER);
+            return false;
+        }
+        if (cgi_header_len > 0)
+            _response.init_gzip_cgi(_request, cgi_header_len, _cgi_handler.is_done());
+    }
+
+    size_t header_len = header.size() - header.pos();
+    size_t budget = max_len > header_len ? max_len - header_len : 0;
+    _add_iov(iov, iov_cnt, &header[header.pos()], header_len);
+    switch (_response.body_type()) {
+        case http::Response::BODY_BUFFER:
+            body_len = body.size() - body.pos();
+            body_len = body_len < budget ? body_len : budget;
+            is_body_buffer = body_len > 0;
+            _add_iov(iov, iov_cnt, &body[body.pos()], body_len);
+            break;
+        case http::Response::BODY_FILE:
+            // Part header of the first range of a multipart response
+            body_len = body.size() - body.pos();
+            if (body_len > 0) {
+                _add_iov(iov, iov_cnt, &body[body.pos()], body_len);
+                body.set_pos(body.size());
+                budget = budget > body_len ? budget - body_len : 0;
+            }
+            body_len = _response.file_handler().read(budget);
+            _add_iov(iov, iov_cnt, _response.file_handler().buf(), body_len);
+            break;
+        case http::Response::BODY_CGI: {
+            if (cgi_header_len == 0)
+                break;
+            _add_iov(iov, iov_cnt, &body[body.pos()], cgi_header_len);
+            body.set_pos(body.pos() + cgi_header_len);
+            // The start of the CGI body follows as the first chunk
+            body_len = body.size() - body.pos();
+            if (budget < cgi_header_len + _max_pipe_size_str.size() + 4)
+                body_len = 0;
+            else if (body_len > budget - cgi_header_len - _max_pipe_size_str.size() - 4)
+                body_len = budget - cgi_header_len - _max_pipe_size_str.size() - 4;
+            const uint8_t* chunk_data = NULL;
+            if (body_len > 0) {
+                chunk_data = &body[body.pos()];
+                body.set_pos(body.pos() + body_len);
+                if (_response.gzip_encoder().is_active()) {
+                    _response.gzip_encoder().compress(chunk_data, body_len, false, compressed);
+                    chunk_data = compressed.empty() ? NULL : &compressed[0];
+                    body_len = compressed.size();
+                }
+            }
+            // A CGI that already ended with all of its output here needs no further send. The last
+            // chunk on its own would be a small write behind unacknowledged data, which Nagle holds
+            // back until the delayed ACK of the client.
+            is_cgi_end = _cgi_handler.is_done() && body.pos() >= body.size() &&
+                         !_response.gzip_encoder().is_active();
+            if (body_len > 0) {
+                utils::num_to_str_hex(body_len, chunk_head);
+                chunk_head += "\r\n";
+                _add_iov(iov, iov_cnt, chunk_head.c_str(), chunk_head.size());
+                _add_iov(iov, iov_cnt, chunk_data, body_len);
+                if (is_cgi_end)
+                    _add_iov(iov, iov_cnt, "\r\n0\r\n\r\n", 7);
+                else
+                    _add_iov(iov, iov_cnt, "\r\n", 2);
+            } else if (is_cgi_end) {
+                _add_iov(iov, iov_cnt, "0\r\n\r\n", 5);
+            }
+            break;
+        }
+        case http::Response::BODY_LISTING:
+        case http::Response::BODY_CACHED:
+        case http::Response::BODY_NONE:
+            break;
+    }
+
+    ssize_t sent_len = writev(_fd, iov, iov_cnt);
+    if (sent_len == -1)
+        throw std::runtime_error("writev: failed");
+    header.set_pos(header.size());
+    for (int i = 0; i < iov_cnt; i++) {
+        size_t iov_sent_len = (size_t)sent_len < iov[i].iov_len ? sent_len : iov[i].iov_len;
+        sent_len -= iov_sent_len;
+        if (is_body_buffer && i == iov_cnt - 1)
+            body.set_pos(body.pos() + iov_sent_len);
+        else if (iov_sent_len < iov[i].iov_len)
+            _unsent.append(static_cast<const char*>(iov[i].iov_base) + iov_sent_len,
+                           iov[i].iov_len - iov_sent_len);
+    }
+
+    switch (_response.body_type()) {
+        case http::Response::BODY_BUFFER:
+            _response.set_state(body.pos() >= body.size() ? http::Response::DONE
+                                                          : http::Response::BODY);
+            break;
+        case http::Response::BODY_FILE:
+            _response.set_state(_response.file_handler().left_size() == 0 &&
+                                        !_response.next_range_part()
+                                    ? http::Response::DONE
+                                    : http::Response::BODY);
+            break;
+        case http::Response::BODY_CGI:
+            _resume_cgi(eni);
+            if (iov_cnt == 1) {
+                _response.set_state(http::Response::HEADER_CGI);
+                break;
+            }
+            if (is_cgi_end) {
+                _response.set_state(http::Response::DONE);
+                break;
+            }
+            _response.set_state(http::Response::BODY);
+            if (body.pos() >= body.size() && !_cgi_handler.is_done() && _unsent.empty() &&
+                !_start_splice()) {
+                eni.disable_event(_fd, EVFILT_WRITE);
+                eni.delete_event(_fd, EVFILT_TIMER);
+                return false;
+            }
+            break;
+        case http::Response::BODY_LISTING:
+            _response.set_state(http::Response::BODY);
+            break;
+        case http::Response::BODY_CACHED:
+        case http::Response::BODY_NONE:
+            _response.set_state(http::Response::DONE);
+            break;
+    }
+    if (_response.state() == http::Response::DONE)
+        _is_active = false;
+    return true;
+}
+
+void Connection::_add_iov(struct iovec* iov, int& iov_cnt, const void* data, size_t len) {
+    if (len == 0)
+        return;
+    iov[iov_cnt].iov_base = const_cast<void*>(data);
+    iov[iov_cnt].iov_len = len;
+    iov_cnt++;
+}
+
+// Sends data as one chunk, compressed first if the response is gzip encoded. The last call of a
+// compressed response adds the end of the gzip stream.
+void Connection::_send_chunk(const uint8_t* data, size_t len, bool is_last) {
+    core::ByteBuffer compressed(0);
+    if (_response.gzip_encoder().is_active()) {
+        _response.gzip_encoder().compress(data, len, is_last, compressed);
+        data = compressed.empty() ? NULL : &compressed[0];
+        len = compressed.size();
+    }
+    if (len == 0)
+        return;
+
+    std::string chunk;
+    chunk.reserve(len + _max_pipe_size_str.size() + 4);
+    utils::num_to_str_hex(len, chunk);
+    chunk += "\r\n";
+    chunk.append(reinterpret_cast<const char*>(data), len);
+    chunk += "\r\n";
+    _send(chunk.c_str(), chunk.size());
+}
+
+// Once the buffered start of a CGI body is out, the rest of it is spliced from the pipe to the
+// socket. Compressed output and FastCGI records have to pass through user space and keep the
+// buffered path.
+bool Connection::_start_splice() {
+#if defined(__linux__)
+    if (!_is_splice_enabled || _response.gzip_encoder().is_active() ||
+        _cgi_handler.get_read_fd() == -1 || _cgi_handler.is_fastcgi())
+        return false;
+    _response.body().clear();
+    _response.body().set_pos(0);
+    _cgi_handler.set_splicing(true);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Moves CGI output from the pipe to the socket without copying it through user space. A chunk is
+// as long as the pipe holds when it starts, its size line and CRLF are sent as small writes.
+bool Connection::_splice_cgi(EventNotificationInterface& eni, size_t max_len) {
+#if defined(__linux__)
+    int pipe_fd = _cgi_handler.get_read_fd();
+
+    if (_splice_left == 0) {
+        int ready_len = 0;
+        if (ioctl(pipe_fd, FIONREAD, &ready_len) == -1)
+            throw std::runtime_error("ioctl: " + std::string(strerror(errno)));
+        if (ready_len == 0 && _cgi_handler.is_hung_up()) {
+            _cgi_handler.eof_read(eni);
+            return true;
+        }
+        if (ready_len == 0) {
+            // Nothing to move before the CGI writes again, its pipe wakes us up
+            eni.disable_event(_fd, EVFILT_WRITE);
+            eni.delete_event(_fd, EVFILT_TIMER);
+            eni.enable_event(pipe_fd, EVFILT_READ);
+            return false;
+        }
+        _splice_left = (size_t)ready_len < max_len ? ready_len : max_len;
+        std::string chunk_head;
+        utils::num_to_str_hex(_splice_left, chunk_head);
+        chunk_head += "\r\n";
+        _send(chunk_head.c_str(), chunk_head.size(), MSG_MORE);
+        if (!_unsent.empty())
+            return true;
+    }
+
+    ssize_t moved_len = splice(pipe_fd, NULL, _fd, NULL, _splice_left,
+                               SPLICE_F_NONBLOCK | SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (moved_len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return true;
+    if (moved_len == -1 && (errno == EINVAL || errno == ENOSYS)) {
+        // The socket does not take spliced data, the announced chunk is sent from memory and the
+        // buffered path takes over
+        std::vector<char> chunk(_splice_left + 2);
+        if (::read(pipe_fd, &chunk[0], _splice_left) != (ssize_t)_splice_left)
+            throw std::runtime_error("read: CGI output truncated");
+        chunk[_splice_left] = '\r';
+        chunk[_splice_left + 1] = '\n';
+        _send(&chunk[0], chunk.size());
+        _splice_left = 0;
+        _is_splice_enabled = false;
+        _cgi_handler.set_splicing(false);
+        eni.enable_event(pipe_fd, EVFILT_READ);
+        return true;
+    }
+    if (moved_len == -1)
+        throw std::runtime_error("splice: " + std::string(strerror(errno)));
+    if (moved_len == 0)
+        throw std::runtime_error("splice: CGI output truncated");
+    _splice_left -= moved_len;
+    if (_splice_left == 0)
+        _send("\r\n", 2);
+    return true;
+#else
+    (void)eni;
+    (void)max_len;
+    return false;
+#endif
+}
+
+// Data queued behind bytes the socket did not take yet waits for them, or the stream would be
+// reordered
+void Connection::_send(const char* data, size_t len, int flags) {
+    if (!_unsent.empty()) {
+        _unsent.append(data, len);
+        return;
+    }
+    ssize_t sent_len = send(_fd, data, len, flags);
+    if (sent_len == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+        throw std::runtime_error("send: failed");
+    if (sent_len == -1)
+        sent_len = 0;
+    // The socket may take less than offered, the rest goes out first on the next write event
+    if ((size_t)sent_len < len)
+        _unsent.append(data + sent_len, len - sent_len);
+}
+
 void Connection::destroy(EventNotificationInterface& eni) {
     close(_fd);
     _fd = -1;
     _cgi_handler.reset(eni);
+    _upload_handler.abort();
 
 #if PRINT_LEVEL > 0
     std::cout << utils::COLOR_YE << "[Closed]: " << utils::COLOR_NO
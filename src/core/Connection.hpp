@@ -6,6 +6,7 @@
 #include "Address.hpp"
 #include "CgiHandler.hpp"
 #include "EventNotificationInterface.hpp"
+#include "UploadHandler.hpp"
 
 namespace core {
 
@@ -22,28 +23,54 @@ class Connection {
     bool           _should_close;
     bool           _is_active;
     bool           _is_request_done;
+    bool           _is_response_built;
     int            _request_error;
     CgiHandler     _cgi_handler;
+    UploadHandler  _upload_handler;
+    ByteBuffer     _unsent;
+    bool           _is_splice_configured;  // cgi_splice
+    bool           _is_splice_enabled;     // off once the socket refused spliced data
+    size_t         _splice_left;
 
     const size_t             BUF_SIZE;
     static const std::string _max_pipe_size_str;
 
-    void _build_cgi_env();
+    void   _build_cgi_env();
+    size_t _cgi_header_len();
+    void   _resume_cgi(EventNotificationInterface& eni);
+    bool   _send_header(EventNotificationInterface& eni, size_t max_len);
+    void   _continue_body(EventNotificationInterface& eni);
+    void   _continue_upload();
+    void   _add_iov(struct iovec* iov, int& iov_cnt, const void* data, size_t len);
+    void   _send_chunk(const uint8_t* data, size_t len, bool is_last);
+    bool   _start_splice();
+    bool   _splice_cgi(EventNotificationInterface& eni, size_t max_len);
+    void   _send(const char* data, size_t len, int flags = 0);
 
    public:
     Connection();
+    Connection(const Connection& other);
     ~Connection();
 
     bool is_active() const;
     bool is_request_done() const;
+    bool is_header_done() const;
     bool is_response_done() const;
     bool should_close() const;
 
     int fd() const;
 
+    void set_caches(OpenFileCache* open_file_cache, ResponseCache* response_cache,
+                    ResponseCache* listing_cache);
+    void set_cgi_splice(bool is_enabled);
+    void set_cgi_spawner(const CgiSpawner* cgi_spawner);
+    void set_fastcgi_pool(FastCgiPool* fastcgi_pool);
+    void set_cgi_pool(CgiPool* cgi_pool);
+    void set_cgi_output_buffer_size(size_t size);
+    void set_client_body_temp_path(const std::string& path);
     void init(int fd, Address client_addr, Address socket_addr);
     void reinit();
-    void receive(size_t data_len);
+    size_t receive(size_t data_len);
     void parse_request(const std::vector<config::Server>& v_server);
     void build_response(EventNotificationInterface& eni);
     bool send_response(EventNotificationInterface& eni, size_t max_len);
@@ -0,0 +1,170 @@
+#include "DirLister.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "../http/status_codes.hpp"
+#include "../utils/html_escape.hpp"
+
+namespace core {
+
+// Percent encodes everything but unreserved characters, so any file name works as a link
+static std::string uri_encode(const char *str) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string       encoded;
+
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '.' || c == '_' || c == '~') {
+            encoded += c;
+        } else {
+            encoded += '%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 15];
+        }
+    }
+    return encoded;
+}
+
+static void append_size(off_t size, ByteBuffer &out) {
+    static const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB", "PiB"};
+    double             value = size;
+    size_t             unit = 0;
+    char               buf[32];
+
+    while (value >= 1024.0 && unit < sizeof(units) / sizeof(units[0]) - 1) {
+        value /= 1024.0;
+        unit++;
+    }
+    snprintf(buf, sizeof(buf), "%.2f %s", value, units[unit]);
+    out.append(buf);
+}
+
+static void append_time(time_t t, ByteBuffer &out) {
+    struct tm time_buf;
+    char      buf[32];
+
+    gmtime_r(&t, &time_buf);
+    size_t len = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S UTC", &time_buf);
+    out.append(buf, len);
+}
+
+DirLister::DirLister() : _dir(NULL), _mtime(0), _size(0) {}
+
+DirLister::DirLister(const DirLister &other) : _dir(NULL), _mtime(other._mtime), _size(0) {}
+
+DirLister::~DirLister() { close(); }
+
+void DirLister::open(const std::string &path) {
+    close();
+    _dir = opendir(path.c_str());
+    if (!_dir) {
+        if (errno == EACCES)
+            throw HTTP_FORBIDDEN;
+        if (errno == ENOENT || errno == ENOTDIR)
+            throw HTTP_NOT_FOUND;
+        throw HTTP_INTERNAL_SERVER_ERROR;
+    }
+    fcntl(dirfd(_dir), F_SETFD, FD_CLOEXEC);
+    struct stat dir_stat;
+    if (fstat(dirfd(_dir), &dir_stat) == -1) {
+        close();
+        throw HTTP_INTERNAL_SERVER_ERROR;
+    }
+    _mtime = dir_stat.st_mtime;
+    _size = dir_stat.st_size;
+}
+
+void DirLister::render_head(const std::string &uri_path, ByteBuffer &out) {
+    std::string title = utils::html_escape(uri_path);
+
+    out.append("<html>\r\n<head><title>Index of ");
+    out.append(title.c_str());
+    out.append("</title></head>\r\n<body>\r\n<h2>Index of ");
+    out.append(title.c_str());
+    out.append("</h2>\r\n<table border='2'>\r\n");
+    out.append("<tr><th>Type</th><th>Name</th><th>Size</th><th>Last Modified</th></tr>\r\n");
+    out.append("<tr><td>Directory</td><td><a href='../'>..</a></td><td></td><td></td></tr>\r\n");
+}
+
+// Appends entries until max_len is reached, the end of the page follows the last one
+bool DirLister::render(ByteBuffer &out, size_t max_len) {
+    while (out.size() < max_len) {
+        errno = 0;
+        struct dirent *entry = readdir(_dir);
+        if (!entry) {
+            if (errno != 0)
+                throw std::runtime_error("readdir: " + std::string(strerror(errno)));
+            out.append("</table>\r\n<hr><center>webserv</center>\r\n</body>\r\n</html>\r\n");
+            close();
+            return true;
+        }
+        // Hidden files stay hidden, which includes uploads that are still in progress
+        if (entry->d_name[0] != '.')
+            _render_entry(entry->d_name, out);
+    }
+    return false;
+}
+
+// Links are shown as what they point to if that is a directory, like a click on them would
+void DirLister::_render_entry(const char *name, ByteBuffer &out) {
+    struct stat entry_stat;
+    const char *type = "Unknown";
+    bool        is_dir = false;
+
+    if (fstatat(dirfd(_dir), name, &entry_stat, AT_SYMLINK_NOFOLLOW) == -1)
+        return;
+    if (S_ISLNK(entry_stat.st_mode)) {
+        type = "Link";
+        struct stat target_stat;
+        if (fstatat(dirfd(_dir), name, &target_stat, 0) == 0) {
+            entry_stat = target_stat;
+            is_dir = S_ISDIR(target_stat.st_mode);
+        }
+    } else if (S_ISREG(entry_stat.st_mode)) {
+        type = "File";
+    } else {
+        is_dir = S_ISDIR(entry_stat.st_mode);
+    }
+    if (is_dir)
+        type = "Directory";
+
+    std::string display_name = utils::html_escape(name);
+    out.append("<tr><td>");
+    out.append(type);
+    out.append("</td><td><a href='");
+    out.append(uri_encode(name).c_str());
+    if (is_dir)
+        out.append("/");
+    out.append("'>");
+    out.append(display_name.c_str());
+    if (is_dir)
+        out.append("/");
+    out.append("</a></td><td>");
+    if (!is_dir)
+        append_size(entry_stat.st_size, out);
+    out.append("</td><td>");
+    append_time(entry_stat.st_mtime, out);
+    out.append("</td></tr>\r\n");
+}
+
+void DirLister::close() {
+    if (!_dir)
+        return;
+    closedir(_dir);
+    _dir = NULL;
+}
+
+bool DirLister::is_open() const { return _dir != NULL; }
+
+time_t DirLister::mtime() const { return _mtime; }
+
+off_t DirLister::size() const { return _size; }
+
+}  // namespace core
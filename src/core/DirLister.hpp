@@ -0,0 +1,38 @@
+#pragma once
+
+#include <dirent.h>
+#include <sys/types.h>
+
+#include <ctime>
+#include <string>
+
+#include "ByteBuffer.hpp"
+
+namespace core {
+
+// Renders the autoindex page of a directory with readdir. The page is written in parts, so a
+// directory with many entries can be sent while it is still read.
+class DirLister {
+   private:
+    DIR   *_dir;
+    time_t _mtime;
+    off_t  _size;
+
+    void _render_entry(const char *name, ByteBuffer &out);
+
+   public:
+    DirLister();
+    DirLister(const DirLister &other);
+    ~DirLister();
+
+    void open(const std::string &path);
+    void render_head(const std::string &uri_path, ByteBuffer &out);
+    bool render(ByteBuffer &out, size_t max_len);
+    void close();
+
+    bool   is_open() const;
+    time_t mtime() const;
+    off_t  size() const;
+};
+
+}  // namespace core
@@ -1,19 +1,27 @@
 #include "EventNotificationInterface.hpp"
 
 #include <cerrno>
+#include <cstring>
+#include <ctime>
 #include <stdexcept>
 
 #include "Socket.hpp"
 
 namespace core {
 
-EventNotificationInterface::EventNotificationInterface(const std::map<int, Socket>& m_server)
-    : _m_socket(m_server) {
+#if defined(ENI_BACKEND_KQUEUE)
+
+// Timers expiring in a poll are appended after the polled events
+static const int MAX_EVENTS = 2 * MAX_POLLED_EVENTS;
+
+EventNotificationInterface::EventNotificationInterface()
+    : _num_events(0), _first_timer_event(0), _v_expired_fd(MAX_POLLED_EVENTS) {
     _kq_fd = kqueue();
     if (_kq_fd == -1) {
         throw std::runtime_error("kqueue: " + std::string(strerror(errno)));
     }
-    events = new struct kevent[MAX_POLLED_EVENTS];
+    _v_change.reserve(MAX_POLLED_EVENTS);
+    events = new Event[MAX_EVENTS];
 }
 
 EventNotificationInterface::~EventNotificationInterface() {
@@ -22,57 +30,369 @@ EventNotificationInterface::~EventNotificationInterface() {
 }
 
 int EventNotificationInterface::add_event(int fd, int16_t filter) {
-    struct kevent event;
-    EV_SET(&event, fd, filter, EV_ADD, 0, 0, NULL);
-    return kevent(_kq_fd, &event, 1, NULL, 0, NULL);
+    _queue_change(fd, filter, EV_ADD, 0);
+    return 0;
 }
 
-int EventNotificationInterface::add_timer(int fd, ssize_t ms) {
-    struct kevent event;
-    EV_SET(&event, fd, EVFILT_TIMER, EV_ADD | EV_ONESHOT, 0, ms, NULL);
-    return kevent(_kq_fd, &event, 1, NULL, 0, NULL);
+int EventNotificationInterface::_add_connection_events(int fd) {
+    _queue_change(fd, EVFILT_READ, EV_ADD, 0);
+    _queue_change(fd, EVFILT_WRITE, EV_ADD | EV_DISABLE, 0);
+    return 0;
 }
 
 int EventNotificationInterface::delete_event(int fd, int16_t filter) {
-    struct kevent event;
-    EV_SET(&event, fd, filter, EV_DELETE, 0, 0, NULL);
-    return kevent(_kq_fd, &event, 1, NULL, 0, NULL);
+    _invalidate_events(fd, filter);
+    if (filter == EVFILT_TIMER)
+        return _timers.remove(fd) ? 0 : -1;
+    _queue_change(fd, filter, EV_DELETE, 0);
+    return 0;
 }
 
 int EventNotificationInterface::poll_events() {
-    return kevent(_kq_fd, NULL, 0, events, MAX_POLLED_EVENTS, NULL);
+    struct timespec  timeout;
+    struct timespec* timeout_ptr = NULL;
+    int              timeout_ms = _timers.timeout(_now_ms());
+    if (timeout_ms != -1) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+        timeout_ptr = &timeout;
+    }
+
+    _num_events = 0;
+    int num_polled = kevent(_kq_fd, _v_change.empty() ? NULL : &_v_change[0], _v_change.size(),
+                            events, MAX_POLLED_EVENTS, timeout_ptr);
+    _v_change.clear();
+    if (num_polled == -1) {
+        if (errno != EINTR)
+            return -1;
+        num_polled = 0;
+    }
+    _num_events = _append_timers(num_polled);
+    return _num_events;
 }
 
-const Socket* EventNotificationInterface::find_socket(int fd) {
-    std::map<int, Socket>::const_iterator it = _m_socket.find(fd);
-    if (it != _m_socket.end())
-        return &it->second;
-    return NULL;
+int EventNotificationInterface::enable_event(int fd, int16_t filter) {
+    _queue_change(fd, filter, EV_ENABLE, 0);
+    return 0;
 }
 
-CgiHandler* EventNotificationInterface::find_cgi(int fd) {
-    std::map<int, CgiHandler*>::iterator it = _m_cgi.find(fd);
-    if (it != _m_cgi.end())
-        return it->second;
-    return NULL;
+int EventNotificationInterface::disable_event(int fd, int16_t filter) {
+    _invalidate_events(fd, filter);
+    _queue_change(fd, filter, EV_DISABLE, 0);
+    return 0;
 }
 
-void EventNotificationInterface::add_cgi_fd(int fd, CgiHandler* cgi) {
-    _m_cgi.insert(std::pair<int, CgiHandler*>(fd, cgi));
+// Changes are submitted together with the next poll, a newer change for the same fd and filter
+// replaces or extends the queued one
+void EventNotificationInterface::_queue_change(int fd, int16_t filter, uint16_t flags,
+                                               intptr_t data) {
+    typedef std::vector<struct kevent>::reverse_iterator change_it_t;
+
+    for (change_it_t it = _v_change.rbegin(); it != _v_change.rend(); ++it) {
+        if (it->ident != (uintptr_t)fd || it->filter != filter)
+            continue;
+        if (flags & (EV_ENABLE | EV_DISABLE)) {
+            if (it->flags & EV_ADD) {
+                it->flags = (it->flags & ~(EV_ENABLE | EV_DISABLE)) | flags;
+                return;
+            }
+            if (it->flags & (EV_ENABLE | EV_DISABLE)) {
+                it->flags = flags;
+                return;
+            }
+            break;
+        }
+        EV_SET(&*it, fd, filter, flags, 0, data, NULL);
+        return;
+    }
+    struct kevent change;
+    EV_SET(&change, fd, filter, flags, 0, data, NULL);
+    _v_change.push_back(change);
 }
 
-void EventNotificationInterface::remove_cgi_fd(int fd) { _m_cgi.erase(fd); }
+#elif defined(ENI_BACKEND_EPOLL)
+
+// Every epoll event can turn into a read and a write event, expired timers are appended after them
+static const int MAX_EVENTS = 3 * MAX_POLLED_EVENTS;
+
+EventNotificationInterface::EventNotificationInterface()
+    : _num_events(0), _first_timer_event(0), _v_expired_fd(MAX_POLLED_EVENTS) {
+    _epoll_fd = epoll_create(MAX_POLLED_EVENTS);
+    if (_epoll_fd == -1) {
+        throw std::runtime_error("epoll_create: " + std::string(strerror(errno)));
+    }
+    _epoll_events = new struct epoll_event[MAX_POLLED_EVENTS];
+    events = new Event[MAX_EVENTS];
+}
+
+EventNotificationInterface::~EventNotificationInterface() {
+    delete[] events;
+    delete[] _epoll_events;
+    close(_epoll_fd);
+}
+
+int EventNotificationInterface::add_event(int fd, int16_t filter) {
+    if (fd < 0)
+        return -1;
+    if ((size_t)fd >= _v_fd.size()) {
+        FdEntry entry = {0, false, false, 0};
+        _v_fd.resize(fd + 1, entry);
+    }
+    uint8_t state = _v_fd[fd].state;
+    if (filter == EVFILT_READ)
+        state |= READ_ADDED | READ_ENABLED;
+    else if (filter == EVFILT_WRITE)
+        state |= WRITE_ADDED | WRITE_ENABLED;
+    else
+        return -1;
+    return _update(fd, state);
+}
+
+int EventNotificationInterface::_add_connection_events(int fd) {
+    if (fd < 0)
+        return -1;
+    if ((size_t)fd >= _v_fd.size()) {
+        FdEntry entry = {0, false, false, 0};
+        _v_fd.resize(fd + 1, entry);
+    }
+    return _update(fd, READ_ADDED | READ_ENABLED | WRITE_ADDED);
+}
+
+int EventNotificationInterface::delete_event(int fd, int16_t filter) {
+    _invalidate_events(fd, filter);
+    if (filter == EVFILT_TIMER)
+        return _timers.remove(fd) ? 0 : -1;
+    if (fd < 0 || (size_t)fd >= _v_fd.size())
+        return -1;
+    uint8_t state = _v_fd[fd].state;
+    if (filter == EVFILT_READ)
+        state &= ~(READ_ADDED | READ_ENABLED);
+    else if (filter == EVFILT_WRITE)
+        state &= ~(WRITE_ADDED | WRITE_ENABLED);
+    else
+        return -1;
+    return _update(fd, state);
+}
 
 int EventNotificationInterface::enable_event(int fd, int16_t filter) {
-    struct kevent event;
-    EV_SET(&event, fd, filter, EV_ENABLE, 0, 0, NULL);
-    return kevent(_kq_fd, &event, 1, NULL, 0, NULL);
+    if (fd < 0 || (size_t)fd >= _v_fd.size())
+        return -1;
+    uint8_t state = _v_fd[fd].state;
+    if (filter == EVFILT_READ && (state & READ_ADDED))
+        state |= READ_ENABLED;
+    else if (filter == EVFILT_WRITE && (state & WRITE_ADDED))
+        state |= WRITE_ENABLED;
+    else
+        return -1;
+    return _update(fd, state);
 }
 
 int EventNotificationInterface::disable_event(int fd, int16_t filter) {
-    struct kevent event;
-    EV_SET(&event, fd, filter, EV_DISABLE, 0, 0, NULL);
-    return kevent(_kq_fd, &event, 1, NULL, 0, NULL);
+    if (fd < 0 || (size_t)fd >= _v_fd.size())
+        return -1;
+    _invalidate_events(fd, filter);
+    uint8_t state = _v_fd[fd].state;
+    if (filter == EVFILT_READ && (state & READ_ADDED))
+        state &= ~READ_ENABLED;
+    else if (filter == EVFILT_WRITE && (state & WRITE_ADDED))
+        state &= ~WRITE_ENABLED;
+    else
+        return -1;
+    return _update(fd, state);
+}
+
+int EventNotificationInterface::poll_events() {
+    _num_events = 0;
+    _flush_changes();
+    int num_polled =
+        epoll_wait(_epoll_fd, _epoll_events, MAX_POLLED_EVENTS, _timers.timeout(_now_ms()));
+    if (num_polled == -1) {
+        if (errno != EINTR)
+            return -1;
+        num_polled = 0;
+    }
+
+    int num_events = 0;
+    for (int i = 0; i < num_polled; i++) {
+        int      fd = _epoll_events[i].data.fd;
+        uint32_t flags = _epoll_events[i].events;
+        uint8_t  state = (size_t)fd < _v_fd.size() ? _v_fd[fd].state : 0;
+        bool     hang_up = flags & (EPOLLHUP | EPOLLERR);
+        bool     reported = false;
+
+        if ((state & READ_ENABLED) && (flags & (EPOLLIN | EPOLLRDHUP) || hang_up)) {
+            _set_event(events[num_events++], fd, EVFILT_READ,
+                       hang_up || flags & EPOLLRDHUP ? EV_EOF : 0,
+                       flags & EPOLLIN ? EPOLL_EVENT_DATA : 0);
+            reported = true;
+        }
+        if ((state & WRITE_ENABLED) && (flags & EPOLLOUT || hang_up)) {
+            _set_event(events[num_events++], fd, EVFILT_WRITE, hang_up ? EV_EOF : 0,
+                       flags & EPOLLOUT ? EPOLL_EVENT_DATA : 0);
+            reported = true;
+        }
+        // Hang ups are reported even without interest, they must not be polled forever
+        if (!reported && hang_up)
+            _set_event(events[num_events++], fd, EVFILT_READ, EV_EOF, 0);
+    }
+    _num_events = _append_timers(num_events);
+    return _num_events;
 }
 
+// Only removals reach the kernel right away, because the fd is closed right after and may live
+// on in a CGI child. Everything else is applied once per fd before the next poll.
+int EventNotificationInterface::_update(int fd, uint8_t new_state) {
+    FdEntry& entry = _v_fd[fd];
+    entry.state = new_state;
+    if (!(new_state & (READ_ADDED | WRITE_ADDED))) {
+        if (!entry.is_registered)
+            return 0;
+        entry.is_registered = false;
+        return epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    if (!entry.is_dirty) {
+        entry.is_dirty = true;
+        _v_dirty_fd.push_back(fd);
+    }
+    return 0;
+}
+
+void EventNotificationInterface::_flush_changes() {
+    for (size_t i = 0; i < _v_dirty_fd.size(); i++) {
+        int      fd = _v_dirty_fd[i];
+        FdEntry& entry = _v_fd[fd];
+        entry.is_dirty = false;
+        if (!(entry.state & (READ_ADDED | WRITE_ADDED)))
+            continue;
+
+        struct epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.data.fd = fd;
+        if (entry.state & READ_ENABLED)
+            event.events |= EPOLLIN | EPOLLRDHUP;
+        if (entry.state & WRITE_ENABLED)
+            event.events |= EPOLLOUT;
+        if (entry.is_registered && entry.registered_events == event.events)
+            continue;
+
+        int op = entry.is_registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(_epoll_fd, op, fd, &event) == -1) {
+            // The fd was closed and reused without deleting its events before
+            if (op == EPOLL_CTL_MOD && errno == ENOENT)
+                op = EPOLL_CTL_ADD;
+            else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+                op = EPOLL_CTL_MOD;
+            else
+                continue;
+            if (epoll_ctl(_epoll_fd, op, fd, &event) == -1)
+                continue;
+        }
+        entry.is_registered = true;
+        entry.registered_events = event.events;
+    }
+    _v_dirty_fd.clear();
+}
+
+#endif
+
+// Timers live in user space, re-arming one on every read or write costs no syscall
+int EventNotificationInterface::add_timer(int fd, ssize_t ms) {
+    _invalidate_events(fd, EVFILT_TIMER);
+    _timers.add(fd, _now_ms() + ms);
+    return 0;
+}
+
+// Expired timers are reaped in one go after each poll and appended as timer events
+int EventNotificationInterface::_append_timers(int num_events) {
+    size_t num_expired = _timers.expire(_now_ms(), &_v_expired_fd[0], _v_expired_fd.size());
+
+    _first_timer_event = num_events;
+    for (size_t i = 0; i < num_expired; i++)
+        _set_event(events[num_events++], _v_expired_fd[i], EVFILT_TIMER, 0, 0);
+    return num_events;
+}
+
+void EventNotificationInterface::_invalidate_events(int fd, int16_t filter) {
+    int i = filter == EVFILT_TIMER ? _first_timer_event : 0;
+    int end = filter == EVFILT_TIMER ? _num_events : _first_timer_event;
+
+    for (; i < end; i++) {
+        if (events[i].ident == (uintptr_t)fd && events[i].filter == filter)
+            events[i].filter = EVFILT_NONE;
+    }
+}
+
+void EventNotificationInterface::_set_event(Event& event, int fd, int16_t filter, uint16_t flags,
+                                            intptr_t data) {
+#if defined(ENI_BACKEND_KQUEUE)
+    EV_SET(&event, fd, filter, flags, 0, data, NULL);
+#elif defined(ENI_BACKEND_EPOLL)
+    event.ident = fd;
+    event.filter = filter;
+    event.flags = flags;
+    event.data = data;
+#endif
+}
+
+int64_t EventNotificationInterface::_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void EventNotificationInterface::_set_owner(int fd, OwnerType type, void* ptr) {
+    if (fd < 0)
+        return;
+    if ((size_t)fd >= _v_owner.size()) {
+        FdOwner owner = {OWNER_NONE, NULL};
+        _v_owner.resize(fd + 1, owner);
+    }
+    _v_owner[fd].type = type;
+    _v_owner[fd].ptr = ptr;
+}
+
+void* EventNotificationInterface::_find_owner(int fd, OwnerType type) const {
+    if (fd < 0 || (size_t)fd >= _v_owner.size() || _v_owner[fd].type != type)
+        return NULL;
+    return _v_owner[fd].ptr;
+}
+
+const Socket* EventNotificationInterface::find_socket(int fd) const {
+    return static_cast<const Socket*>(_find_owner(fd, OWNER_SOCKET));
+}
+
+Connection* EventNotificationInterface::find_connection(int fd) const {
+    return static_cast<Connection*>(_find_owner(fd, OWNER_CONNECTION));
+}
+
+CgiHandler* EventNotificationInterface::find_cgi(int fd) const {
+    return static_cast<CgiHandler*>(_find_owner(fd, OWNER_CGI));
+}
+
+void EventNotificationInterface::add_socket_fd(int fd, const Socket* socket) {
+    _set_owner(fd, OWNER_SOCKET, const_cast<Socket*>(socket));
+}
+
+// A new connection waits for its request, its write event is registered disabled right away
+int EventNotificationInterface::add_connection_fd(int fd, Connection* connection,
+                                                  ssize_t timeout_ms) {
+    if (_add_connection_events(fd) || add_timer(fd, timeout_ms))
+        return -1;
+    _set_owner(fd, OWNER_CONNECTION, connection);
+    return 0;
+}
+
+void EventNotificationInterface::remove_connection_fd(int fd) {
+    delete_event(fd, EVFILT_TIMER);
+    delete_event(fd, EVFILT_READ);
+    delete_event(fd, EVFILT_WRITE);
+    _set_owner(fd, OWNER_NONE, NULL);
+}
+
+void EventNotificationInterface::add_cgi_fd(int fd, CgiHandler* cgi) {
+    _set_owner(fd, OWNER_CGI, cgi);
+}
+
+void EventNotificationInterface::remove_cgi_fd(int fd) { _set_owner(fd, OWNER_NONE, NULL); }
+
 }  // namespace core
@@ -1,32 +1,115 @@
 #pragma once
 
+#if !defined(ENI_BACKEND_KQUEUE) && !defined(ENI_BACKEND_EPOLL)
+#if defined(__linux__)
+#define ENI_BACKEND_EPOLL
+#else
+#define ENI_BACKEND_KQUEUE
+#endif
+#endif
+
+#if defined(ENI_BACKEND_KQUEUE)
 #include <sys/event.h>
+#elif defined(ENI_BACKEND_EPOLL)
+#include <sys/epoll.h>
+#endif
+#include <stdint.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #include <cstdlib>
+#include <map>
 #include <string>
 #include <vector>
 
+#include "../settings.hpp"
 #include "CgiHandler.hpp"
 #include "Socket.hpp"
+#include "TimerWheel.hpp"
+
+// Marks polled events that went stale while the current batch is handled
+#define EVFILT_NONE 0
+
+#if defined(ENI_BACKEND_EPOLL)
+// epoll has no filters, the kqueue names are kept so callers stay backend agnostic
+#define EVFILT_READ (-1)
+#define EVFILT_WRITE (-2)
+#define EVFILT_TIMER (-7)
+#define EV_EOF 0x8000
+#define EV_ERROR 0x4000
 
-#define MAX_POLLED_EVENTS 1
+// epoll does not report the number of ready bytes, so readiness events carry this budget
+#define EPOLL_EVENT_DATA 65536
+#endif
 
 namespace core {
 
 class CgiHandler;
+class Connection;
+
+#if defined(ENI_BACKEND_KQUEUE)
+typedef struct kevent Event;
+#elif defined(ENI_BACKEND_EPOLL)
+struct Event {
+    uintptr_t ident;
+    int16_t   filter;
+    uint16_t  flags;
+    intptr_t  data;
+};
+#endif
 
 class EventNotificationInterface {
    private:
-    int                          _kq_fd;
-    std::map<int, CgiHandler*>   _m_cgi;
-    const std::map<int, Socket>& _m_socket;
+#if defined(ENI_BACKEND_KQUEUE)
+    int                        _kq_fd;
+    std::vector<struct kevent> _v_change;
+
+    void _queue_change(int fd, int16_t filter, uint16_t flags, intptr_t data);
+    int  _add_connection_events(int fd);
+#elif defined(ENI_BACKEND_EPOLL)
+    enum FdState { READ_ADDED = 1, READ_ENABLED = 2, WRITE_ADDED = 4, WRITE_ENABLED = 8 };
+
+    struct FdEntry {
+        uint8_t  state;
+        bool     is_registered;
+        bool     is_dirty;
+        uint32_t registered_events;
+    };
+
+    int                  _epoll_fd;
+    struct epoll_event*  _epoll_events;
+    std::vector<FdEntry> _v_fd;
+    std::vector<int>     _v_dirty_fd;
+
+    int  _update(int fd, uint8_t new_state);
+    void _flush_changes();
+    int  _add_connection_events(int fd);
+#endif
+    // Objects owning an fd, indexed by fd so events are dispatched without a lookup
+    enum OwnerType { OWNER_NONE, OWNER_SOCKET, OWNER_CONNECTION, OWNER_CGI };
+
+    struct FdOwner {
+        OwnerType type;
+        void*     ptr;
+    };
+
+    int                  _num_events;
+    int                  _first_timer_event;
+    std::vector<FdOwner> _v_owner;
+    TimerWheel           _timers;
+    std::vector<int>     _v_expired_fd;
+
+    int            _append_timers(int num_events);
+    void           _invalidate_events(int fd, int16_t filter);
+    void           _set_event(Event& event, int fd, int16_t filter, uint16_t flags, intptr_t data);
+    void           _set_owner(int fd, OwnerType type, void* ptr);
+    void*          _find_owner(int fd, OwnerType type) const;
+    static int64_t _now_ms();
 
    public:
-    struct kevent* events;
+    Event* events;
 
-    EventNotificationInterface(const std::map<int, Socket>& m_socket);
+    EventNotificationInterface();
     ~EventNotificationInterface();
 
     int add_event(int fd, int16_t filter);
@@ -36,8 +119,12 @@ class EventNotificationInterface {
     int disable_event(int fd, int16_t filter);
     int poll_events();
 
-    const Socket* find_socket(int fd);
-    CgiHandler*   find_cgi(int fd);
+    const Socket* find_socket(int fd) const;
+    Connection*   find_connection(int fd) const;
+    CgiHandler*   find_cgi(int fd) const;
+    void          add_socket_fd(int fd, const Socket* socket);
+    int           add_connection_fd(int fd, Connection* connection, ssize_t timeout_ms);
+    void          remove_connection_fd(int fd);
     void          add_cgi_fd(int fd, CgiHandler* cgi);
     void          remove_cgi_fd(int fd);
 };
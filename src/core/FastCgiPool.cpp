@@ -0,0 +1,119 @@
+#include "FastCgiPool.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "../http/status_codes.hpp"
+#include "../utils/str_to_num.hpp"
+
+namespace core {
+
+// Splits "host:port" into an IPv4 address and a port, names are not resolved except localhost
+static bool parse_inet_address(const std::string &address, struct sockaddr_in &addr) {
+    size_t colon = address.rfind(':');
+    size_t port = 0;
+
+    if (colon == std::string::npos ||
+        !utils::str_to_num_dec(address.substr(colon + 1), port) || port == 0 || port > 65535)
+        return false;
+    std::string host = address.substr(0, colon);
+    if (host == "localhost")
+        host = "127.0.0.1";
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    return inet_pton(AF_INET, host.c_str(), &addr.sin_addr) == 1;
+}
+
+FastCgiPool::FastCgiPool(size_t max_idle) : _max_idle(max_idle) {}
+
+FastCgiPool::~FastCgiPool() {
+    for (map_t::iterator it = _m_idle.begin(); it != _m_idle.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); i++)
+            close(it->second[i]);
+    }
+}
+
+// Idle connections the server closed in the meantime are dropped on the way
+int FastCgiPool::acquire(const std::string &address) {
+    std::vector<int> &v_idle = _m_idle[address];
+    char              c;
+
+    while (!v_idle.empty()) {
+        int fd = v_idle.back();
+        v_idle.pop_back();
+        if (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == -1 &&
+            (errno == EAGAIN || errno == EWOULDBLOCK))
+            return fd;
+        close(fd);
+    }
+    return _connect(address);
+}
+
+void FastCgiPool::release(const std::string &address, int fd) {
+    std::vector<int> &v_idle = _m_idle[address];
+
+    if (v_idle.size() >= _max_idle) {
+        close(fd);
+        return;
+    }
+    v_idle.push_back(fd);
+}
+
+bool FastCgiPool::is_valid_address(const std::string &address) {
+    struct sockaddr_in addr;
+    struct sockaddr_un addr_un;
+
+    if (address.compare(0, 5, "unix:") == 0)
+        return address.size() > 5 && address.size() - 5 < sizeof(addr_un.sun_path);
+    return parse_inet_address(address, addr);
+}
+
+// The connect may still be in progress, the first write waits for it
+int FastCgiPool::_connect(const std::string &address) {
+    struct sockaddr_storage addr;
+    socklen_t               addr_len;
+
+    std::memset(&addr, 0, sizeof(addr));
+    if (address.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un *addr_un = reinterpret_cast<struct sockaddr_un *>(&addr);
+        addr_un->sun_family = AF_UNIX;
+        std::strncpy(addr_un->sun_path, address.c_str() + 5, sizeof(addr_un->sun_path) - 1);
+        addr_len = sizeof(struct sockaddr_un);
+    } else {
+        if (!parse_inet_address(address, *reinterpret_cast<struct sockaddr_in *>(&addr)))
+            throw HTTP_BAD_GATEWAY;
+        addr_len = sizeof(struct sockaddr_in);
+    }
+
+    int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (fd == -1)
+        throw HTTP_INTERNAL_SERVER_ERROR;
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1 || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+        close(fd);
+        throw HTTP_INTERNAL_SERVER_ERROR;
+    }
+    int optval = 1;
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &optval, sizeof(optval));
+#endif
+    // Records of a request are written as they are framed, none of them should wait for an ACK
+    if (addr.ss_family == AF_INET)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr), addr_len) == -1 &&
+        errno != EINPROGRESS) {
+        close(fd);
+        throw HTTP_BAD_GATEWAY;
+    }
+    return fd;
+}
+
+}  // namespace core
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace core {
+
+// Idle connections to FastCGI servers of one event loop, keyed by the fastcgi_pass address
+// ("unix:/path" or "host:port"). A connection is handed out for one request at a time and comes
+// back once the request ended cleanly, so requests do not pay for a new connection each.
+class FastCgiPool {
+   private:
+    typedef std::map<std::string, std::vector<int> > map_t;
+
+    map_t  _m_idle;
+    size_t _max_idle;
+
+    static int _connect(const std::string &address);
+
+    FastCgiPool(const FastCgiPool &other);
+    FastCgiPool &operator=(const FastCgiPool &other);
+
+   public:
+    explicit FastCgiPool(size_t max_idle);
+    ~FastCgiPool();
+
+    int  acquire(const std::string &address);
+    void release(const std::string &address, int fd);
+
+    static bool is_valid_address(const std::string &address);
+};
+
+}  // namespace core
@@ -0,0 +1,123 @@
+#include "FastCgiStream.hpp"
+
+#include <iostream>
+
+namespace core {
+
+FastCgiStream::FastCgiStream() { init(); }
+
+void FastCgiStream::init() {
+    _header_len = 0;
+    _content_left = 0;
+    _padding_left = 0;
+    _is_ended = false;
+}
+
+// Content is padded to a multiple of 8 bytes, as the protocol recommends
+void FastCgiStream::_append_header(ByteBuffer &out, Type type, size_t content_len) {
+    uint8_t header[HEADER_LEN] = {1,
+                                  (uint8_t)type,
+                                  (uint8_t)(REQUEST_ID >> 8),
+                                  (uint8_t)(REQUEST_ID & 0xff),
+                                  (uint8_t)(content_len >> 8),
+                                  (uint8_t)(content_len & 0xff),
+                                  (uint8_t)((8 - content_len % 8) % 8),
+                                  0};
+    out.insert(out.end(), header, header + HEADER_LEN);
+}
+
+// Lengths below 128 take one byte, longer ones four with the high bit set
+void FastCgiStream::_append_len(std::string &params, size_t len) {
+    if (len < 128) {
+        params += (char)len;
+        return;
+    }
+    params += (char)((len >> 24) | 0x80);
+    params += (char)((len >> 16) & 0xff);
+    params += (char)((len >> 8) & 0xff);
+    params += (char)(len & 0xff);
+}
+
+// The connection is kept open once the request is answered
+void FastCgiStream::append_begin_request(ByteBuffer &out) {
+    static const uint8_t body[] = {0, 1, 1, 0, 0, 0, 0, 0};  // responder role, keep conn
+
+    _append_header(out, BEGIN_REQUEST, sizeof(body));
+    out.insert(out.end(), body, body + sizeof(body));
+}
+
+// Name value pairs are split over as many records as needed, an empty record ends them
+void FastCgiStream::append_params(ByteBuffer                               &out,
+                                  const std::map<std::string, std::string> &params) {
+    typedef std::map<std::string, std::string>::const_iterator param_it_t;
+    std::string encoded;
+
+    for (param_it_t it = params.begin(); it != params.end(); ++it) {
+        _append_len(encoded, it->first.size());
+        _append_len(encoded, it->second.size());
+        encoded += it->first;
+        encoded += it->second;
+    }
+    for (size_t pos = 0; pos < encoded.size(); pos += MAX_CONTENT_LEN) {
+        size_t len = encoded.size() - pos < MAX_CONTENT_LEN ? encoded.size() - pos
+                                                            : MAX_CONTENT_LEN;
+        _append_header(out, PARAMS, len);
+        out.append(encoded.c_str() + pos, len);
+        out.insert(out.end(), (8 - len % 8) % 8, 0);
+    }
+    _append_header(out, PARAMS, 0);
+}
+
+// An empty slice ends the body
+void FastCgiStream::append_stdin(ByteBuffer &out, const uint8_t *data, size_t len) {
+    if (len == 0) {
+        _append_header(out, STDIN, 0);
+        return;
+    }
+    for (size_t pos = 0; pos < len; pos += MAX_CONTENT_LEN) {
+        size_t record_len = len - pos < MAX_CONTENT_LEN ? len - pos : MAX_CONTENT_LEN;
+        _append_header(out, STDIN, record_len);
+        out.insert(out.end(), data + pos, data + pos + record_len);
+        out.insert(out.end(), (8 - record_len % 8) % 8, 0);
+    }
+}
+
+// Appends stdout content to out and passes stderr on to the log. Returns how much of data was
+// used, which is less than len only once the end of the request was parsed.
+size_t FastCgiStream::parse(const uint8_t *data, size_t len, ByteBuffer &out) {
+    size_t pos = 0;
+
+    while (pos < len && !_is_ended) {
+        bool is_own = _header_len == HEADER_LEN && (_header[2] << 8 | _header[3]) == REQUEST_ID;
+        if (_header_len < HEADER_LEN) {
+            _header[_header_len++] = data[pos++];
+            if (_header_len < HEADER_LEN)
+                continue;
+            _content_left = (size_t)_header[4] << 8 | _header[5];
+            _padding_left = _header[6];
+            is_own = (_header[2] << 8 | _header[3]) == REQUEST_ID;
+        } else if (_content_left > 0) {
+            size_t content_len = len - pos < _content_left ? len - pos : _content_left;
+            if (is_own && _header[1] == STDOUT)
+                out.append(reinterpret_cast<const char *>(data + pos), content_len);
+            else if (is_own && _header[1] == STDERR)
+                std::cerr.write(reinterpret_cast<const char *>(data + pos), content_len);
+            pos += content_len;
+            _content_left -= content_len;
+        } else {
+            size_t padding_len = len - pos < _padding_left ? len - pos : _padding_left;
+            pos += padding_len;
+            _padding_left -= padding_len;
+        }
+        if (_content_left == 0 && _padding_left == 0) {
+            if (is_own && _header[1] == END_REQUEST)
+                _is_ended = true;
+            _header_len = 0;
+        }
+    }
+    return pos;
+}
+
+bool FastCgiStream::is_ended() const { return _is_ended; }
+
+}  // namespace core
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "ByteBuffer.hpp"
+
+namespace core {
+
+// Records of the FastCGI protocol for a single request over a connection that is kept open.
+// Request bodies are framed slice by slice, responses are parsed as they arrive in any slices.
+class FastCgiStream {
+   public:
+    enum Type {
+        BEGIN_REQUEST = 1,
+        ABORT_REQUEST = 2,
+        END_REQUEST = 3,
+        PARAMS = 4,
+        STDIN = 5,
+        STDOUT = 6,
+        STDERR = 7
+    };
+
+    static const size_t   HEADER_LEN = 8;
+    static const size_t   MAX_CONTENT_LEN = 65535;
+    static const uint16_t REQUEST_ID = 1;
+
+   private:
+    uint8_t _header[HEADER_LEN];
+    size_t  _header_len;
+    size_t  _content_left;
+    size_t  _padding_left;
+    bool    _is_ended;
+
+    static void _append_header(ByteBuffer &out, Type type, size_t content_len);
+    static void _append_len(std::string &params, size_t len);
+
+   public:
+    FastCgiStream();
+
+    void init();
+
+    static void append_begin_request(ByteBuffer &out);
+    static void append_params(ByteBuffer &out, const std::map<std::string, std::string> &params);
+    static void append_stdin(ByteBuffer &out, const uint8_t *data, size_t len);
+
+    size_t parse(const uint8_t *data, size_t len, ByteBuffer &out);
+    bool   is_ended() const;
+};
+
+}  // namespace core
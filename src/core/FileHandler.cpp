@@ -1,81 +1,186 @@
 #include "FileHandler.hpp"
 
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#elif defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
 #include "../http/status_codes.hpp"
 
 namespace core {
 
-FileHandler::FileHandler() : _max_size(0), _read_size(0) { _buf = new char[BUF_SIZE]; }
+// Upper bound for one sendfile call, the socket takes less whenever its buffer is full
+static const size_t SENDFILE_MAX_SIZE = 1 << 30;
+
+FileHandler::FileHandler()
+    : _cache(NULL),
+      _entry(NULL),
+      _fd(-1),
+      _max_size(0),
+      _read_size(0),
+      _end_size(0),
+      _has_range(false),
+      _is_sendfile_usable(true) {
+    _buf = new char[BUF_SIZE];
+}
 
 FileHandler::FileHandler(const FileHandler &other) {
     if (this != &other) {
+        _cache = other._cache;
+        _entry = NULL;
+        _fd = -1;
         _max_size = 0;
         _read_size = 0;
+        _end_size = 0;
+        _has_range = false;
+        _is_sendfile_usable = true;
         _buf = new char[BUF_SIZE];
     }
 }
 
 FileHandler::~FileHandler() {
     delete[] _buf;
-    if (_file.is_open()) {
-        _file.close();
-    }
+    _release();
 }
 
+void FileHandler::set_cache(OpenFileCache *cache) { _cache = cache; }
+
 bool FileHandler::init(const std::string &path) {
-    if (_file.is_open()) {
-        _file.close();
-    }
+    close();
     _path = path;
-    _file.open(path);
-    if (!_file.is_open()) {
-        if (errno == EACCES)
-            throw HTTP_FORBIDDEN;
-        else if (errno == EISDIR)
+    switch (_cache->open(path, _entry)) {
+        case OpenFileCache::FILE_REGULAR:
+            break;
+        case OpenFileCache::FILE_DIRECTORY:
             return false;
-        else
+        case OpenFileCache::FILE_FORBIDDEN:
+            throw HTTP_FORBIDDEN;
+        case OpenFileCache::FILE_NOT_FOUND:
             throw HTTP_NOT_FOUND;
+        default:
+            throw HTTP_INTERNAL_SERVER_ERROR;
     }
-    _file.seekg(0, _file.end);
-    _max_size = _file.tellg();
+    _fd = _entry->fd;
+    _max_size = _entry->size;
     _read_size = 0;
-    _file.seekg(0, _file.beg);
+    _end_size = _max_size;
+    _has_range = false;
     return true;
 }
 
+// Limits reading and sending to len bytes from offset. The file stays open after the range, so
+// further ranges of it can follow until close().
+void FileHandler::set_range(size_t offset, size_t len) {
+    _read_size = offset;
+    _end_size = offset + len;
+    _has_range = true;
+}
+
+// Buffered path, reads the next part of the file into buf()
 size_t FileHandler::read(size_t max_len) {
-    if (_file) {
-        size_t to_read_len = max_len < BUF_SIZE ? max_len : BUF_SIZE;
-        _file.read(_buf, to_read_len);
-        size_t read_bytes = _file.gcount();
-        _read_size += read_bytes;
-        if (left_size() == 0) {
-            _file.close();
-        }
-        return read_bytes;
-    } else {
-        _file.close();
+    if (_fd == -1 || left_size() == 0)
+        return 0;
+    size_t to_read_len = max_len < BUF_SIZE ? max_len : BUF_SIZE;
+    if (to_read_len > left_size())
+        to_read_len = left_size();
+    if (to_read_len == 0)
+        return 0;
+    ssize_t read_bytes = pread(_fd, _buf, to_read_len, _read_size);
+    if (read_bytes == -1)
+        throw std::runtime_error("read: " + std::string(strerror(errno)));
+    if (read_bytes == 0)
+        throw std::runtime_error("read: file truncated");
+    _read_size += read_bytes;
+    if (left_size() == 0 && !_has_range)
+        _release();
+    return read_bytes;
+}
+
+// Sends the next part of the file from the page cache straight to the socket, as much as the
+// socket takes. Returns the number of bytes sent, or -1 if sendfile can not be used for the file
+// and the buffered path has to take over.
+ssize_t FileHandler::send_to(int socket_fd) {
+    if (_fd == -1 || !_is_sendfile_usable)
+        return -1;
+    if (left_size() == 0)
+        return 0;
+    size_t to_send_len = left_size() < SENDFILE_MAX_SIZE ? left_size() : SENDFILE_MAX_SIZE;
+
+#if defined(__linux__)
+    off_t   offset = _read_size;
+    ssize_t sent_len = sendfile(socket_fd, _fd, &offset, to_send_len);
+    if (sent_len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
         return 0;
+#elif defined(__APPLE__)
+    off_t   len = to_send_len;
+    ssize_t sent_len = sendfile(_fd, socket_fd, _read_size, &len, NULL, 0);
+    // A partial send reports EAGAIN together with the bytes that went out
+    if (sent_len == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
+        sent_len = len;
+    if (sent_len == 0)
+        return 0;
+#else
+    (void)socket_fd;
+    (void)to_send_len;
+    errno = ENOSYS;
+    ssize_t sent_len = -1;
+#endif
+
+    if (sent_len == -1) {
+        if (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP || errno == ENOTSUP) {
+            _is_sendfile_usable = false;
+            return -1;
+        }
+        throw std::runtime_error("sendfile: " + std::string(strerror(errno)));
     }
+    if (sent_len == 0)
+        throw std::runtime_error("sendfile: file truncated");
+
+    _read_size += sent_len;
+    if (left_size() == 0 && !_has_range)
+        _release();
+    return sent_len;
 }
 
 void FileHandler::close() {
-    if (_file.is_open()) {
-        _file.close();
-    }
+    _release();
     _max_size = 0;
     _read_size = 0;
+    _end_size = 0;
+    _has_range = false;
+    _is_sendfile_usable = true;
 }
 
-bool FileHandler::is_open() const { return _file.is_open(); }
+bool FileHandler::is_open() const { return _fd != -1; }
 
 std::size_t FileHandler::max_size() const { return _max_size; }
 
 std::size_t FileHandler::read_size() const { return _read_size; }
 
-std::size_t FileHandler::left_size() const { return _max_size - _read_size; }
+std::size_t FileHandler::left_size() const { return _end_size - _read_size; }
+
+time_t FileHandler::mtime() const { return _entry ? _entry->mtime : 0; }
+
+ino_t FileHandler::ino() const { return _entry ? _entry->ino : 0; }
 
 const std::string &FileHandler::path() const { return _path; }
 
 const char *FileHandler::buf() const { return _buf; }
 
+// The fd belongs to the open file cache, which closes it once no response uses it anymore
+void FileHandler::_release() {
+    if (_entry) {
+        _cache->release(_entry);
+        _entry = NULL;
+    }
+    _fd = -1;
+}
+
 }  // namespace core
@@ -1,21 +1,30 @@
 #pragma once
 
-#include <fstream>
+#include <sys/types.h>
+
 #include <iostream>
 #include <string>
 
 #include "../settings.hpp"
 #include "ByteBuffer.hpp"
+#include "OpenFileCache.hpp"
 
 namespace core {
 
 class FileHandler {
    private:
-    std::string  _path;
-    std::fstream _file;
-    std::size_t  _max_size;
-    std::size_t  _read_size;
-    char        *_buf;
+    OpenFileCache        *_cache;
+    OpenFileCache::Entry *_entry;
+    std::string           _path;
+    int                   _fd;
+    std::size_t           _max_size;
+    std::size_t           _read_size;
+    std::size_t           _end_size;
+    bool                  _has_range;
+    bool                  _is_sendfile_usable;
+    char                 *_buf;
+
+    void _release();
 
    public:
     static const size_t BUF_SIZE = FILE_BUF_SIZE;
@@ -24,15 +33,20 @@ class FileHandler {
     FileHandler(const FileHandler &other);
     ~FileHandler();
 
-    bool   init(const std::string &path);
-    size_t read(size_t max_len);
-    void   close();
+    void    set_cache(OpenFileCache *cache);
+    bool    init(const std::string &path);
+    void    set_range(size_t offset, size_t len);
+    size_t  read(size_t max_len);
+    ssize_t send_to(int socket_fd);
+    void    close();
 
     bool is_open() const;
 
     std::size_t max_size() const;
     std::size_t read_size() const;
     std::size_t left_size() const;
+    time_t      mtime() const;
+    ino_t       ino() const;
 
     const std::string &path() const;
     const char        *buf() const;
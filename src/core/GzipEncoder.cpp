@@ -0,0 +1,51 @@
+#include "GzipEncoder.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "../settings.hpp"
+
+namespace core {
+
+GzipEncoder::GzipEncoder() : _is_active(false) { memset(&_stream, 0, sizeof(_stream)); }
+
+GzipEncoder::~GzipEncoder() { end(); }
+
+void GzipEncoder::init(int level) {
+    end();
+    memset(&_stream, 0, sizeof(_stream));
+    // 16 added to the window bits selects the gzip wrapper instead of zlib
+    if (deflateInit2(&_stream, level, Z_DEFLATED, 15 + 16, GZIP_MEM_LEVEL, Z_DEFAULT_STRATEGY) !=
+        Z_OK)
+        throw std::runtime_error("deflateInit2: failed");
+    _is_active = true;
+}
+
+// Appends the compressed data to out, a sync flush ends every call on a byte boundary so the
+// client can decode everything sent so far
+void GzipEncoder::compress(const uint8_t *data, size_t len, bool is_last, ByteBuffer &out) {
+    _stream.next_in = const_cast<Bytef *>(data);
+    _stream.avail_in = len;
+    do {
+        size_t out_pos = out.size();
+        out.resize(out_pos + GZIP_BUF_SIZE);
+        _stream.next_out = &out[out_pos];
+        _stream.avail_out = GZIP_BUF_SIZE;
+        if (deflate(&_stream, is_last ? Z_FINISH : Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+            throw std::runtime_error("deflate: failed");
+        out.resize(out_pos + GZIP_BUF_SIZE - _stream.avail_out);
+    } while (_stream.avail_out == 0);
+    if (is_last)
+        end();
+}
+
+void GzipEncoder::end() {
+    if (_is_active) {
+        deflateEnd(&_stream);
+        _is_active = false;
+    }
+}
+
+bool GzipEncoder::is_active() const { return _is_active; }
+
+}  // namespace core
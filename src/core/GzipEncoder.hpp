@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <zlib.h>
+
+#include <cstddef>
+
+#include "ByteBuffer.hpp"
+
+namespace core {
+
+// Streaming gzip compression with zlib, every call flushes so the output can be sent right away
+class GzipEncoder {
+   private:
+    z_stream _stream;
+    bool     _is_active;
+
+    GzipEncoder(const GzipEncoder &other);
+    GzipEncoder &operator=(const GzipEncoder &other);
+
+   public:
+    GzipEncoder();
+    ~GzipEncoder();
+
+    void init(int level);
+    void compress(const uint8_t *data, size_t len, bool is_last, ByteBuffer &out);
+    void end();
+    bool is_active() const;
+};
+
+}  // namespace core
@@ -0,0 +1,271 @@
+#include "Master.hpp"
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/prctl.h>
+#endif
+#include <pthread.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "../utils/color.hpp"
+#include "../utils/timestamp.hpp"
+#include "Webserver.hpp"
+
+namespace core {
+
+// Exit status of a worker that could not start serving, respawning it would fail the same way.
+// A worker that fails later exits with EXIT_FAILURE and is respawned.
+static const int EXIT_WORKER_FATAL = 2;
+
+static volatile sig_atomic_t g_is_stopping = 0;
+
+static void stop_handler(int) { g_is_stopping = 1; }
+
+struct EventLoop {
+    const config::Global              *global;
+    const std::vector<config::Server> *v_server;
+    const CgiSpawner                  *cgi_spawner;
+    size_t                             index;
+    bool                               is_shared;
+};
+
+static size_t resolve_count(uint32_t count) {
+    if (count != WORKERS_AUTO)
+        return count;
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus < 1)
+        return 1;
+    return std::min(num_cpus, (long)MAX_WORKERS);
+}
+
+// Event loops sharing the machine are pinned round-robin to the online CPUs
+static void pin_to_cpu(size_t index) {
+#if defined(__linux__)
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus < 1)
+        return;
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(index % num_cpus, &cpu_set);
+    if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == -1) {
+        std::cerr << "[";
+        utils::print_timestamp(std::cerr);
+        std::cerr << "]: sched_setaffinity: " << strerror(errno) << '\n';
+    }
+#else
+    (void)index;
+#endif
+}
+
+static void print_error(const std::exception &e) {
+    std::cerr << "[";
+    utils::print_timestamp(std::cerr);
+    std::cerr << "]: " << e.what() << '\n';
+}
+
+// Every event loop owns its Webserver, with a listen socket per loop if there is more than one.
+// Only setting it up is fatal, an error while serving ends the process to be respawned.
+static void *run_event_loop(void *arg) {
+    const EventLoop &loop = *static_cast<EventLoop *>(arg);
+
+    if (loop.is_shared)
+        pin_to_cpu(loop.index);
+    Webserver *webserver = NULL;
+    try {
+        webserver = new Webserver(*loop.global, *loop.v_server, *loop.cgi_spawner, loop.is_shared);
+    } catch (const std::exception &e) {
+        print_error(e);
+        exit(EXIT_WORKER_FATAL);
+    }
+    try {
+        webserver->run();
+    } catch (const std::exception &e) {
+        print_error(e);
+        exit(EXIT_FAILURE);
+    }
+    delete webserver;
+    return NULL;
+}
+
+Master::Master(const config::Global &global, const std::vector<config::Server> &v_server,
+               const CgiSpawner &cgi_spawner)
+    : _global(global),
+      _v_server(v_server),
+      _cgi_spawner(cgi_spawner),
+      _num_workers(resolve_count(global.worker_processes)),
+      _num_threads(resolve_count(global.worker_threads)) {}
+
+Master::~Master() {}
+
+void Master::run() {
+    if (_num_workers == 1) {
+        _run_event_loops(0);
+        return;
+    }
+
+    // No SA_RESTART, so the waitpid below returns when the master is told to stop
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    Worker worker = {-1, 0, -1, 0};
+    _v_worker.resize(_num_workers, worker);
+    for (size_t i = 0; i < _num_workers; i++) {
+        _v_worker[i].pid = _spawn_worker(i);
+        _v_worker[i].started = _now_ms();
+    }
+
+    while (!g_is_stopping) {
+        // While a respawn is pending the master only polls for dead workers and sleeps until it
+        // is due, a signal ends the sleep early
+        int64_t wait_ms = _respawn_due(_now_ms());
+        int     status;
+        pid_t   pid = waitpid(-1, &status, wait_ms == -1 ? 0 : WNOHANG);
+        if (pid == 0 || (pid == -1 && errno == ECHILD && wait_ms != -1)) {
+            struct timespec ts = {(time_t)(wait_ms / 1000), (long)(wait_ms % 1000) * 1000000};
+            nanosleep(&ts, NULL);
+            continue;
+        }
+        if (pid == -1) {
+            if (errno == EINTR)
+                continue;
+            _stop_workers();
+            throw std::runtime_error("waitpid: " + std::string(strerror(errno)));
+        }
+
+        std::vector<Worker>::iterator it = _v_worker.begin();
+        while (it != _v_worker.end() && it->pid != pid)
+            ++it;
+        if (it == _v_worker.end())
+            continue;
+        it->pid = -1;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_WORKER_FATAL) {
+            _stop_workers();
+            throw std::runtime_error("worker could not be started");
+        }
+        _schedule_respawn(*it, _now_ms());
+
+        std::cerr << "[";
+        utils::print_timestamp(std::cerr);
+        std::cerr << "]: worker " << pid << " died, respawning in " << it->delay << "ms\n";
+    }
+    _stop_workers();
+}
+
+pid_t Master::_spawn_worker(size_t index) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        _stop_workers();
+        throw std::runtime_error("fork: " + std::string(strerror(errno)));
+    }
+    if (pid == 0)
+        _run_worker(index);
+
+#if PRINT_LEVEL > 0
+    std::cout << utils::COLOR_CY_1 << "[Worker " << index << "]: " << utils::COLOR_NO << pid
+              << std::endl;
+#endif
+    return pid;
+}
+
+void Master::_run_worker(size_t index) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+#if defined(__linux__)
+    // Workers must not outlive a master that was killed
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+
+    try {
+        _run_event_loops(index);
+    } catch (const std::exception &e) {
+        print_error(e);
+        exit(EXIT_WORKER_FATAL);
+    }
+    exit(EXIT_SUCCESS);
+}
+
+// A worker that lived long enough is respawned at once, one that keeps dying young waits longer
+// each time, so a crash loop does not keep the master forking
+void Master::_schedule_respawn(Worker &worker, int64_t now) {
+    if (now - worker.started >= RESPAWN_RESET_TIME)
+        worker.delay = 0;
+    else if (worker.delay == 0)
+        worker.delay = RESPAWN_MIN_DELAY;
+    else
+        worker.delay = std::min(worker.delay * 2, (int64_t)RESPAWN_MAX_DELAY);
+    worker.respawn_at = now + worker.delay;
+}
+
+// Respawns the workers that are due, returns the ms until the next one or -1 if none is waiting
+int64_t Master::_respawn_due(int64_t now) {
+    int64_t wait_ms = -1;
+    for (std::vector<Worker>::iterator it = _v_worker.begin(); it != _v_worker.end(); ++it) {
+        if (it->respawn_at == -1)
+            continue;
+        if (it->respawn_at <= now) {
+            it->pid = _spawn_worker(it - _v_worker.begin());
+            it->started = now;
+            it->respawn_at = -1;
+        } else if (wait_ms == -1 || it->respawn_at - now < wait_ms) {
+            wait_ms = it->respawn_at - now;
+        }
+    }
+    return wait_ms;
+}
+
+// Runs the event loops of one process, the calling thread runs the first one
+void Master::_run_event_loops(size_t index) {
+    std::vector<EventLoop> v_loop(_num_threads);
+    for (size_t i = 0; i < _num_threads; i++) {
+        v_loop[i].global = &_global;
+        v_loop[i].v_server = &_v_server;
+        v_loop[i].cgi_spawner = &_cgi_spawner;
+        v_loop[i].index = index * _num_threads + i;
+        v_loop[i].is_shared = _num_workers * _num_threads > 1;
+    }
+
+    for (size_t i = 1; i < _num_threads; i++) {
+        pthread_t thread;
+        int       error = pthread_create(&thread, NULL, run_event_loop, &v_loop[i]);
+        if (error)
+            throw std::runtime_error("pthread_create: " + std::string(strerror(error)));
+        pthread_detach(thread);
+    }
+    run_event_loop(&v_loop[0]);
+}
+
+void Master::_stop_workers() {
+    for (std::vector<Worker>::iterator it = _v_worker.begin(); it != _v_worker.end(); ++it) {
+        if (it->pid != -1)
+            kill(it->pid, SIGTERM);
+    }
+    for (std::vector<Worker>::iterator it = _v_worker.begin(); it != _v_worker.end(); ++it) {
+        if (it->pid != -1)
+            waitpid(it->pid, NULL, 0);
+        it->pid = -1;
+        it->respawn_at = -1;
+    }
+}
+
+int64_t Master::_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+}  // namespace core
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+#include "../config/Global.hpp"
+#include "../config/Server.hpp"
+#include "CgiSpawner.hpp"
+
+namespace core {
+
+// Runs the webserver in one process, or forks worker processes and respawns workers that die.
+// Every process runs one event loop per worker thread. A worker that keeps dying soon after it
+// was started is respawned with a growing delay.
+class Master {
+   private:
+    struct Worker {
+        pid_t   pid;
+        int64_t started;
+        int64_t respawn_at;  // -1 while running
+        int64_t delay;
+    };
+
+    const config::Global              &_global;
+    const std::vector<config::Server> &_v_server;
+    const CgiSpawner                  &_cgi_spawner;
+    std::vector<Worker>                _v_worker;
+    size_t                             _num_workers;
+    size_t                             _num_threads;
+
+    pid_t          _spawn_worker(size_t index);
+    void           _run_worker(size_t index);
+    void           _run_event_loops(size_t index);
+    void           _schedule_respawn(Worker &worker, int64_t now);
+    int64_t        _respawn_due(int64_t now);
+    void           _stop_workers();
+    static int64_t _now_ms();
+
+   public:
+    Master(const config::Global &global, const std::vector<config::Server> &v_server,
+           const CgiSpawner &cgi_spawner);
+    ~Master();
+
+    void run();
+};
+
+}  // namespace core
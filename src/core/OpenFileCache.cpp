@@ -0,0 +1,194 @@
+#include "OpenFileCache.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <iostream>
+
+#include "../settings.hpp"
+#include "../utils/color.hpp"
+
+namespace core {
+
+OpenFileCache::OpenFileCache(size_t max_entries, uint32_t valid_sec, bool cache_errors)
+    : _max_entries(max_entries),
+      _valid_ms((int64_t)valid_sec * 1000),
+      _cache_errors(cache_errors),
+      _hits(0),
+      _misses(0),
+      _logged_lookups(0),
+      _next_sweep(0) {}
+
+OpenFileCache::~OpenFileCache() {
+    while (!_l_lru.empty())
+        _evict(_l_lru.back());
+}
+
+// Regular files come back with a referenced entry, which the caller has to release
+OpenFileCache::Status OpenFileCache::open(const std::string &path, Entry *&entry) {
+    int64_t now = _now_ms();
+    Entry  *found = NULL;
+
+    entry = NULL;
+    if (_max_entries > 0) {
+        if (now >= _next_sweep)
+            _sweep(now);
+        map_t::iterator it = _m_entry.find(path);
+        if (it != _m_entry.end()) {
+            found = it->second;
+            if (now < found->valid_until) {
+                _hits++;
+            } else if (_revalidate(*found, now)) {
+                _misses++;
+            } else {
+                _evict(found);
+                found = NULL;
+            }
+        }
+    }
+
+    if (found) {
+        _l_lru.splice(_l_lru.begin(), _l_lru, found->it_lru);
+    } else {
+        _misses++;
+        found = _load(path);
+        if (_max_entries > 0 && found->status != FILE_ERROR &&
+            (_cache_errors || found->status == FILE_REGULAR || found->status == FILE_DIRECTORY))
+            _insert(found, now);
+    }
+
+    Status status = found->status;
+    if (status == FILE_REGULAR) {
+        found->num_users++;
+        entry = found;
+    } else if (!found->is_cached) {
+        _destroy(found);
+    }
+    return status;
+}
+
+void OpenFileCache::release(Entry *entry) {
+    if (!entry)
+        return;
+    entry->num_users--;
+    if (entry->num_users == 0 && !entry->is_cached)
+        _destroy(entry);
+}
+
+size_t OpenFileCache::size() const { return _m_entry.size(); }
+
+uint64_t OpenFileCache::hits() const { return _hits; }
+
+uint64_t OpenFileCache::misses() const { return _misses; }
+
+OpenFileCache::Entry *OpenFileCache::_load(const std::string &path) {
+    Entry *entry = new Entry();
+    entry->path = path;
+    entry->fd = -1;
+    entry->size = 0;
+    entry->mtime = 0;
+    entry->valid_until = 0;
+    entry->num_users = 0;
+    entry->is_cached = false;
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno == EACCES || errno == EPERM)
+            entry->status = FILE_FORBIDDEN;
+        else if (errno == EMFILE || errno == ENFILE || errno == ENOMEM || errno == EIO)
+            entry->status = FILE_ERROR;
+        else
+            entry->status = FILE_NOT_FOUND;
+        return entry;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        ::close(fd);
+        entry->status = FILE_ERROR;
+        return entry;
+    }
+    entry->mtime = file_stat.st_mtime;
+    entry->dev = file_stat.st_dev;
+    entry->ino = file_stat.st_ino;
+    if (S_ISDIR(file_stat.st_mode)) {
+        ::close(fd);
+        entry->status = FILE_DIRECTORY;
+    } else if (!S_ISREG(file_stat.st_mode)) {
+        ::close(fd);
+        entry->status = FILE_FORBIDDEN;
+    } else {
+        entry->status = FILE_REGULAR;
+        entry->fd = fd;
+        entry->size = file_stat.st_size;
+    }
+    return entry;
+}
+
+// An outdated entry stays if a stat shows the same file, errors are always looked up again
+bool OpenFileCache::_revalidate(Entry &entry, int64_t now) {
+    struct stat file_stat;
+    if (entry.status != FILE_REGULAR && entry.status != FILE_DIRECTORY)
+        return false;
+    if (stat(entry.path.c_str(), &file_stat) == -1)
+        return false;
+    if (entry.status == FILE_DIRECTORY && !S_ISDIR(file_stat.st_mode))
+        return false;
+    if (entry.status == FILE_REGULAR &&
+        (!S_ISREG(file_stat.st_mode) || file_stat.st_dev != entry.dev ||
+         file_stat.st_ino != entry.ino || file_stat.st_size != entry.size ||
+         file_stat.st_mtime != entry.mtime))
+        return false;
+    entry.valid_until = now + _valid_ms;
+    return true;
+}
+
+void OpenFileCache::_insert(Entry *entry, int64_t now) {
+    while (_m_entry.size() >= _max_entries)
+        _evict(_l_lru.back());
+    entry->valid_until = now + _valid_ms;
+    entry->is_cached = true;
+    _l_lru.push_front(entry);
+    entry->it_lru = _l_lru.begin();
+    _m_entry.insert(std::make_pair(entry->path, entry));
+}
+
+void OpenFileCache::_evict(Entry *entry) {
+    _m_entry.erase(entry->path);
+    _l_lru.erase(entry->it_lru);
+    entry->is_cached = false;
+    if (entry->num_users == 0)
+        _destroy(entry);
+}
+
+void OpenFileCache::_destroy(Entry *entry) {
+    if (entry->fd != -1)
+        ::close(entry->fd);
+    delete entry;
+}
+
+// Outdated entries at the cold end are dropped, so files nobody asks for are not held open
+void OpenFileCache::_sweep(int64_t now) {
+    while (!_l_lru.empty() && _l_lru.back()->valid_until <= now)
+        _evict(_l_lru.back());
+    _next_sweep = now + (_valid_ms > 1000 ? _valid_ms : 1000);
+
+#if PRINT_LEVEL > 0
+    if (_hits + _misses != _logged_lookups) {
+        _logged_lookups = _hits + _misses;
+        std::cout << utils::COLOR_CY << "[OpenFileCache]: " << utils::COLOR_NO << _hits
+                  << " hits, " << _misses << " misses, " << _m_entry.size() << " entries"
+                  << std::endl;
+    }
+#endif
+}
+
+int64_t OpenFileCache::_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+}  // namespace core
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+
+namespace core {
+
+// Open fds and stat results of served files keyed by absolute path, so a hit needs no filesystem
+// syscalls. Entries are revalidated with a stat once they are older than the valid time, an
+// evicted file stays open until the last response sending it releases it.
+class OpenFileCache {
+   public:
+    enum Status { FILE_REGULAR, FILE_DIRECTORY, FILE_NOT_FOUND, FILE_FORBIDDEN, FILE_ERROR };
+
+    struct Entry {
+        std::string                  path;
+        Status                       status;
+        int                          fd;
+        off_t                        size;
+        time_t                       mtime;
+        dev_t                        dev;
+        ino_t                        ino;
+        int64_t                      valid_until;
+        size_t                       num_users;
+        bool                         is_cached;
+        std::list<Entry *>::iterator it_lru;
+    };
+
+   private:
+    typedef std::map<std::string, Entry *> map_t;
+
+    map_t              _m_entry;
+    std::list<Entry *> _l_lru;
+    size_t             _max_entries;
+    int64_t            _valid_ms;
+    bool               _cache_errors;
+    uint64_t           _hits;
+    uint64_t           _misses;
+    uint64_t           _logged_lookups;
+    int64_t            _next_sweep;
+
+    Entry         *_load(const std::string &path);
+    bool           _revalidate(Entry &entry, int64_t now);
+    void           _insert(Entry *entry, int64_t now);
+    void           _evict(Entry *entry);
+    void           _destroy(Entry *entry);
+    void           _sweep(int64_t now);
+    static int64_t _now_ms();
+
+    OpenFileCache(const OpenFileCache &other);
+    OpenFileCache &operator=(const OpenFileCache &other);
+
+   public:
+    OpenFileCache(size_t max_entries, uint32_t valid_sec, bool cache_errors);
+    ~OpenFileCache();
+
+    Status open(const std::string &path, Entry *&entry);
+    void   release(Entry *entry);
+
+    size_t   size() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+};
+
+}  // namespace core
@@ -0,0 +1,61 @@
+#include "ResponseCache.hpp"
+
+namespace core {
+
+ResponseCache::ResponseCache(size_t max_entries, size_t max_bytes)
+    : _max_entries(max_entries), _max_bytes(max_bytes), _num_bytes(0) {}
+
+ResponseCache::~ResponseCache() {
+    while (!_l_lru.empty())
+        _evict(_l_lru.back());
+}
+
+bool ResponseCache::is_enabled() const { return _max_entries > 0 && _max_bytes > 0; }
+
+bool ResponseCache::find(const std::string &key, time_t mtime, off_t size,
+                         SharedBuffer &response) {
+    map_t::iterator it = _m_entry.find(key);
+    if (it == _m_entry.end())
+        return false;
+
+    Entry *entry = it->second;
+    if (entry->mtime != mtime || entry->size != size) {
+        _evict(entry);
+        return false;
+    }
+    _l_lru.splice(_l_lru.begin(), _l_lru, entry->it_lru);
+    response = entry->response;
+    response.set_pos(0);
+    return true;
+}
+
+void ResponseCache::insert(const std::string &key, time_t mtime, off_t size,
+                           const SharedBuffer &response) {
+    if (!is_enabled() || response.size() > _max_bytes)
+        return;
+    map_t::iterator it = _m_entry.find(key);
+    if (it != _m_entry.end())
+        _evict(it->second);
+    while (_m_entry.size() >= _max_entries || _num_bytes + response.size() > _max_bytes)
+        _evict(_l_lru.back());
+
+    Entry *entry = new Entry();
+    entry->key = key;
+    entry->mtime = mtime;
+    entry->size = size;
+    entry->response = response;
+    _l_lru.push_front(entry);
+    entry->it_lru = _l_lru.begin();
+    _m_entry.insert(std::make_pair(key, entry));
+    _num_bytes += response.size();
+}
+
+// Responses still being sent keep their buffer through its reference count
+void ResponseCache::_evict(Entry *entry) {
+    _num_bytes -= entry->response.size();
+    _m_entry.erase(entry->key);
+    _l_lru.erase(entry->it_lru);
+    delete entry;
+}
+
+}  // namespace core
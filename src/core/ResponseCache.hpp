@@ -0,0 +1,49 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+
+#include "SharedBuffer.hpp"
+
+namespace core {
+
+// Complete responses of small static files or directory listings, least recently used ones are
+// evicted once the entry or byte limit is reached. An entry is only valid for the mtime and size it
+// was built from.
+class ResponseCache {
+   private:
+    struct Entry {
+        std::string                  key;
+        time_t                       mtime;
+        off_t                        size;
+        SharedBuffer                 response;
+        std::list<Entry *>::iterator it_lru;
+    };
+
+    typedef std::map<std::string, Entry *> map_t;
+
+    map_t              _m_entry;
+    std::list<Entry *> _l_lru;
+    size_t             _max_entries;
+    size_t             _max_bytes;
+    size_t             _num_bytes;
+
+    void _evict(Entry *entry);
+
+    ResponseCache(const ResponseCache &other);
+    ResponseCache &operator=(const ResponseCache &other);
+
+   public:
+    ResponseCache(size_t max_entries, size_t max_bytes);
+    ~ResponseCache();
+
+    bool is_enabled() const;
+    bool find(const std::string &key, time_t mtime, off_t size, SharedBuffer &response);
+    void insert(const std::string &key, time_t mtime, off_t size, const SharedBuffer &response);
+};
+
+}  // namespace core
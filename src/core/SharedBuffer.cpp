@@ -0,0 +1,49 @@
+#include "SharedBuffer.hpp"
+
+namespace core {
+
+SharedBuffer::SharedBuffer() : _data(NULL), _pos(0) {}
+
+SharedBuffer::SharedBuffer(const ByteBuffer &buf) : _data(new Data()), _pos(0) {
+    _data->bytes.assign(buf.begin(), buf.end());
+    _data->num_refs = 1;
+}
+
+SharedBuffer::SharedBuffer(const SharedBuffer &other) : _data(other._data), _pos(other._pos) {
+    if (_data)
+        _data->num_refs++;
+}
+
+SharedBuffer::~SharedBuffer() { _release(); }
+
+SharedBuffer &SharedBuffer::operator=(const SharedBuffer &other) {
+    if (other._data)
+        other._data->num_refs++;
+    _release();
+    _data = other._data;
+    _pos = other._pos;
+    return *this;
+}
+
+const uint8_t *SharedBuffer::data() const { return empty() ? NULL : &_data->bytes[0]; }
+
+size_t SharedBuffer::size() const { return _data ? _data->bytes.size() : 0; }
+
+bool SharedBuffer::empty() const { return size() == 0; }
+
+void SharedBuffer::reset() {
+    _release();
+    _data = NULL;
+    _pos = 0;
+}
+
+size_t SharedBuffer::pos() const { return _pos; }
+
+void SharedBuffer::set_pos(size_t new_pos) { _pos = new_pos; }
+
+void SharedBuffer::_release() {
+    if (_data && --_data->num_refs == 0)
+        delete _data;
+}
+
+}  // namespace core
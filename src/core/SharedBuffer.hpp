@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "ByteBuffer.hpp"
+
+namespace core {
+
+// Immutable bytes shared by reference count, a copy only takes another reference and keeps its
+// own send position. The count is not atomic, a buffer must stay within one event loop.
+class SharedBuffer {
+   private:
+    struct Data {
+        std::vector<uint8_t> bytes;
+        size_t               num_refs;
+    };
+
+    Data  *_data;
+    size_t _pos;
+
+    void _release();
+
+   public:
+    SharedBuffer();
+    explicit SharedBuffer(const ByteBuffer &buf);
+    SharedBuffer(const SharedBuffer &other);
+    ~SharedBuffer();
+
+    SharedBuffer &operator=(const SharedBuffer &other);
+
+    const uint8_t *data() const;
+    size_t         size() const;
+    bool           empty() const;
+    void           reset();
+
+    size_t pos() const;
+    void   set_pos(size_t new_pos);
+};
+
+}  // namespace core
@@ -5,14 +5,18 @@
 #include <unistd.h>
 
 #include <cerrno>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 
 namespace core {
 
-Socket::Socket(in_addr_t bind_addr, in_port_t port) {
+Socket::Socket(in_addr_t bind_addr, in_port_t port, bool reuse_port) {
     _socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     _setsockopt(SOL_SOCKET, SO_REUSEADDR, 1);
+    // Every worker process binds its own listen socket, the kernel spreads connections among them
+    if (reuse_port)
+        _setsockopt(SOL_SOCKET, SO_REUSEPORT, 1);
     if (fcntl(_fd, F_SETFL, O_NONBLOCK) == -1)
         throw std::runtime_error("fcntl: " + std::string(strerror(errno)));
     _bind(bind_addr, port);
@@ -1,6 +1,5 @@
 #pragma once
 
-#include <sys/event.h>
 #include <sys/socket.h>
 
 #include "Address.hpp"
@@ -18,7 +17,7 @@ class Socket {
     void _listen(int backlog = SOMAXCONN);
 
    public:
-    Socket(in_addr_t bind_addr, in_port_t port);
+    Socket(in_addr_t bind_addr, in_port_t port, bool reuse_port = false);
     ~Socket();
 
     int            fd() const;
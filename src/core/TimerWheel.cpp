@@ -0,0 +1,134 @@
+#include "TimerWheel.hpp"
+
+#include <climits>
+#include <limits>
+
+#include "../settings.hpp"
+
+namespace core {
+
+TimerWheel::TimerWheel()
+    : _v_slot(TIMER_WHEEL_SIZE, -1),
+      _tick(0),
+      _num_timers(0),
+      _next_deadline(std::numeric_limits<int64_t>::max()) {}
+
+TimerWheel::~TimerWheel() {}
+
+void TimerWheel::add(int fd, int64_t deadline) {
+    if (fd < 0)
+        return;
+    if ((size_t)fd >= _v_timer.size()) {
+        Timer timer = {0, -1, -1, false};
+        _v_timer.resize(fd + 1, timer);
+    }
+    if (_v_timer[fd].is_armed)
+        _unlink(fd);
+    _v_timer[fd].deadline = deadline;
+    _link(fd);
+    if (deadline < _next_deadline)
+        _next_deadline = deadline;
+}
+
+bool TimerWheel::remove(int fd) {
+    if (fd < 0 || (size_t)fd >= _v_timer.size() || !_v_timer[fd].is_armed)
+        return false;
+    _unlink(fd);
+    return true;
+}
+
+// Milliseconds until the next timer expires, -1 if no timer is armed. A timer removed since the
+// last expiry may make the wait shorter than needed, never longer.
+int TimerWheel::timeout(int64_t now) const {
+    if (_num_timers == 0)
+        return -1;
+    if (_next_deadline <= now)
+        return 0;
+    if (_next_deadline - now > INT_MAX)
+        return INT_MAX;
+    return _next_deadline - now;
+}
+
+// Collects up to max_fd expired timers, the remaining ones are collected by the next call
+size_t TimerWheel::expire(int64_t now, int *v_fd, size_t max_fd) {
+    int64_t now_tick = now / TIMER_TICK_TIME;
+    if (_num_timers == 0 || _tick < now_tick - TIMER_WHEEL_SIZE)
+        _tick = _num_timers == 0 ? now_tick : now_tick - TIMER_WHEEL_SIZE;
+
+    size_t num_expired = 0;
+    while (true) {
+        int fd = _v_slot[_slot(_tick)];
+        while (fd != -1) {
+            int next = _v_timer[fd].next;
+            if (_v_timer[fd].deadline <= now) {
+                if (num_expired == max_fd)
+                    return num_expired;
+                _unlink(fd);
+                v_fd[num_expired++] = fd;
+            }
+            fd = next;
+        }
+        if (_tick >= now_tick)
+            break;
+        _tick++;
+    }
+    // Everything due is gone, the bound may belong to a timer removed or re-armed since
+    if (_next_deadline <= now)
+        _next_deadline = _find_next_deadline();
+    return num_expired;
+}
+
+size_t TimerWheel::size() const { return _num_timers; }
+
+size_t TimerWheel::_slot(int64_t tick) const { return tick % TIMER_WHEEL_SIZE; }
+
+// Walks the slots from the current tick, the first one with a timer of this round holds the
+// earliest deadline. Without one the earliest of the later rounds is taken.
+int64_t TimerWheel::_find_next_deadline() const {
+    int64_t next = std::numeric_limits<int64_t>::max();
+    if (_num_timers == 0)
+        return next;
+    for (int64_t tick = _tick; tick < _tick + TIMER_WHEEL_SIZE; tick++) {
+        bool is_found = false;
+        for (int fd = _v_slot[_slot(tick)]; fd != -1; fd = _v_timer[fd].next) {
+            const Timer &timer = _v_timer[fd];
+            if (timer.deadline < next)
+                next = timer.deadline;
+            if (timer.deadline / TIMER_TICK_TIME <= tick)
+                is_found = true;
+        }
+        if (is_found)
+            break;
+    }
+    return next;
+}
+
+void TimerWheel::_link(int fd) {
+    Timer &timer = _v_timer[fd];
+    int   &head = _v_slot[_slot(timer.deadline / TIMER_TICK_TIME)];
+
+    timer.prev = -1;
+    timer.next = head;
+    if (head != -1)
+        _v_timer[head].prev = fd;
+    head = fd;
+    timer.is_armed = true;
+    _num_timers++;
+}
+
+void TimerWheel::_unlink(int fd) {
+    Timer &timer = _v_timer[fd];
+
+    if (timer.prev != -1)
+        _v_timer[timer.prev].next = timer.next;
+    else
+        _v_slot[_slot(timer.deadline / TIMER_TICK_TIME)] = timer.next;
+    if (timer.next != -1)
+        _v_timer[timer.next].prev = timer.prev;
+    timer.prev = -1;
+    timer.next = -1;
+    timer.is_armed = false;
+    _num_timers--;
+}
+
+}  // namespace core
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace core {
+
+// Hashed timing wheel with one timer per fd. Arming, re-arming and removing a timer only relinks
+// the fd in an intrusive list, timers further away than one revolution stay in their slot until
+// their round comes up. The next deadline is kept as a lower bound that arming lowers and that
+// is only searched for again once it passed, so polling does not walk the wheel.
+class TimerWheel {
+   private:
+    struct Timer {
+        int64_t deadline;
+        int     prev;
+        int     next;
+        bool    is_armed;
+    };
+
+    std::vector<Timer> _v_timer;
+    std::vector<int>   _v_slot;
+    int64_t            _tick;
+    size_t             _num_timers;
+    int64_t            _next_deadline;  // no armed timer expires earlier
+
+    size_t  _slot(int64_t tick) const;
+    int64_t _find_next_deadline() const;
+    void    _link(int fd);
+    void    _unlink(int fd);
+
+   public:
+    TimerWheel();
+    ~TimerWheel();
+
+    void   add(int fd, int64_t deadline);
+    bool   remove(int fd);
+    int    timeout(int64_t now) const;
+    size_t expire(int64_t now, int *v_fd, size_t max_fd);
+    size_t size() const;
+};
+
+}  // namespace core
@@ -0,0 +1,263 @@
+#include "UploadHandler.hpp"
+
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../http/status_codes.hpp"
+#include "../settings.hpp"
+
+namespace core {
+
+// Finds a parameter of a header value like 'form-data; name="file"; filename="a.txt"', quoted
+// values may contain semicolons and escaped quotes
+static bool find_param(const std::string &value, const char *key, std::string &param) {
+    size_t pos = value.find(';');
+
+    while (pos != std::string::npos && pos < value.size()) {
+        while (pos < value.size() && (value[pos] == ';' || value[pos] == ' ' || value[pos] == '\t'))
+            pos++;
+        size_t key_end = value.find_first_of("=;", pos);
+        if (key_end == std::string::npos || value[key_end] == ';') {
+            pos = key_end;
+            continue;
+        }
+        std::string param_key = value.substr(pos, key_end - pos);
+        param.clear();
+        pos = key_end + 1;
+        if (pos < value.size() && value[pos] == '"') {
+            for (pos++; pos < value.size() && value[pos] != '"'; pos++) {
+                if (value[pos] == '\\' && pos + 1 < value.size())
+                    pos++;
+                param += value[pos];
+            }
+            pos = value.find(';', pos);
+        } else {
+            size_t param_end = value.find(';', pos);
+            param = value.substr(pos, param_end == std::string::npos ? param_end : param_end - pos);
+            pos = param_end;
+        }
+        while (!param_key.empty() && (param_key[param_key.size() - 1] == ' ' ||
+                                      param_key[param_key.size() - 1] == '\t'))
+            param_key.erase(param_key.size() - 1);
+        if (strcasecmp(param_key.c_str(), key) == 0)
+            return true;
+    }
+    return false;
+}
+
+// The last path component of a client supplied name, so nothing is written outside the store
+static std::string safe_file_name(const std::string &name) {
+    size_t      slash = name.find_last_of("/\\");
+    std::string base = slash == std::string::npos ? name : name.substr(slash + 1);
+    if (base == "." || base == "..")
+        return "";
+    return base;
+}
+
+// The name a PUT stores its body under, empty for a path with subdirectories, the store has none
+static std::string put_file_name(const std::string &relative_path) {
+    size_t start = relative_path.find_first_not_of('/');
+    if (start == std::string::npos || relative_path.find('/', start) != std::string::npos)
+        return "";
+    return safe_file_name(relative_path.substr(start));
+}
+
+UploadHandler::UploadHandler() : _state(PART_DATA), _fd(-1), _is_created(false) {}
+
+UploadHandler::UploadHandler(const UploadHandler &other)
+    : _state(other._state), _fd(-1), _is_created(false) {}
+
+UploadHandler::~UploadHandler() { abort(); }
+
+void UploadHandler::start(const http::Request &req) {
+    abort();
+    _store = req.location()->upload_store;
+    _delimiter.clear();
+    _pending.clear();
+    _is_created = false;
+    _v_stored.clear();
+
+    if (req.method() == http::Request::PUT) {
+        std::string name = put_file_name(req.relative_path());
+        if (name.empty())
+            throw HTTP_CONFLICT;
+        struct stat file_stat;
+        _is_created = stat((_store + name).c_str(), &file_stat) == -1;
+        _open_file(name, req.content_len());
+        return;
+    }
+
+    typedef std::map<std::string, std::string>::const_iterator header_it_t;
+    header_it_t it = req.m_header().find("CONTENT-TYPE");
+    std::string boundary;
+    if (it == req.m_header().end() || strncasecmp(it->second.c_str(), "multipart/form-data", 19) ||
+        (it->second.size() > 19 && it->second[19] != ';' && it->second[19] != ' '))
+        throw HTTP_UNSUPPORTED_MEDIA_TYPE;
+    if (!find_param(it->second, "boundary", boundary) || boundary.empty() || boundary.size() > 70)
+        throw HTTP_BAD_REQUEST;
+    // The first delimiter may come without a CRLF in front, one is added to the body instead
+    _delimiter = "\r\n--" + boundary;
+    _pending = "\r\n";
+    _state = PART_DATA;
+}
+
+void UploadHandler::write(ByteBuffer &body) {
+    size_t pos = body.pos();
+    if (pos < body.size()) {
+        const char *data = reinterpret_cast<const char *>(&body[pos]);
+        if (_delimiter.empty()) {
+            _write(data, body.size() - pos);
+        } else {
+            _pending.append(data, body.size() - pos);
+            _parse_multipart();
+        }
+    }
+    body.clear();
+    body.set_pos(0);
+}
+
+void UploadHandler::finish() {
+    if (!_delimiter.empty() && _state != PART_END)
+        throw HTTP_BAD_REQUEST;
+    if (_fd != -1)
+        _store_file();
+}
+
+// Drops a file that was not completed
+void UploadHandler::abort() {
+    if (_fd == -1)
+        return;
+    close(_fd);
+    _fd = -1;
+    unlink(_tmp_path.c_str());
+}
+
+bool UploadHandler::is_created() const { return _is_created; }
+
+const std::vector<std::string> &UploadHandler::v_stored() const { return _v_stored; }
+
+// Data is written up to the bytes that may be the start of the next delimiter, those wait for
+// more of the body
+void UploadHandler::_parse_multipart() {
+    size_t pos = 0;
+
+    while (pos < _pending.size()) {
+        if (_state == PART_DATA) {
+            size_t found = _pending.find(_delimiter, pos);
+            if (found == std::string::npos) {
+                size_t keep = _delimiter.size() - 1;
+                if (_pending.size() - pos > keep) {
+                    if (_fd != -1)
+                        _write(&_pending[pos], _pending.size() - pos - keep);
+                    pos = _pending.size() - keep;
+                }
+                break;
+            }
+            if (_fd != -1) {
+                _write(&_pending[pos], found - pos);
+                _store_file();
+            }
+            pos = found + _delimiter.size();
+            _state = PART_AFTER_DELIMITER;
+        } else if (_state == PART_AFTER_DELIMITER) {
+            if (_pending.size() - pos < 2)
+                break;
+            if (_pending.compare(pos, 2, "--") == 0) {
+                _state = PART_END;
+            } else if (_pending.compare(pos, 2, "\r\n") == 0) {
+                // The CRLF stays, an empty part header then ends right at the next one
+                _state = PART_HEADER;
+            } else {
+                throw HTTP_BAD_REQUEST;
+            }
+        } else if (_state == PART_HEADER) {
+            size_t header_end = _pending.find("\r\n\r\n", pos);
+            if (header_end == std::string::npos) {
+                if (_pending.size() - pos > MAX_INFO_LEN)
+                    throw HTTP_BAD_REQUEST;
+                break;
+            }
+            if (header_end > pos)
+                _parse_part_header(_pending.substr(pos + 2, header_end - pos - 2));
+            pos = header_end + 4;
+            _state = PART_DATA;
+        } else {
+            // Epilogue after the last delimiter
+            pos = _pending.size();
+        }
+    }
+    _pending.erase(0, pos);
+}
+
+// Only parts with a file name are stored, other form fields are skipped
+void UploadHandler::_parse_part_header(const std::string &header) {
+    size_t pos = 0;
+
+    while (pos < header.size()) {
+        size_t line_end = header.find("\r\n", pos);
+        if (line_end == std::string::npos)
+            line_end = header.size();
+        std::string line = header.substr(pos, line_end - pos);
+        pos = line_end + 2;
+        if (strncasecmp(line.c_str(), "content-disposition:", 20) != 0)
+            continue;
+        std::string name;
+        if (find_param(line, "filename", name)) {
+            name = safe_file_name(name);
+            if (!name.empty())
+                _open_file(name, 0);
+        }
+        return;
+    }
+}
+
+// A known length is allocated up front, so the file does not fragment while it grows
+void UploadHandler::_open_file(const std::string &name, size_t len) {
+    _name = name;
+    _path = _store + name;
+    _tmp_path = _store + ".upload_XXXXXX";
+    _fd = mkstemp(&_tmp_path[0]);
+    if (_fd == -1)
+        throw HTTP_INTERNAL_SERVER_ERROR;
+    fcntl(_fd, F_SETFD, FD_CLOEXEC);
+    fchmod(_fd, 0644);
+#if defined(__linux__)
+    if (len > 0 && fallocate(_fd, 0, 0, len) == -1 && errno == ENOSPC) {
+        abort();
+        throw HTTP_INSUFFICIENT_STORAGE;
+    }
+#else
+    (void)len;
+#endif
+}
+
+void UploadHandler::_write(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = ::write(_fd, data, len);
+        if (written == -1) {
+            int error = errno == ENOSPC ? HTTP_INSUFFICIENT_STORAGE : HTTP_INTERNAL_SERVER_ERROR;
+            abort();
+            throw error;
+        }
+        data += written;
+        len -= written;
+    }
+}
+
+void UploadHandler::_store_file() {
+    close(_fd);
+    _fd = -1;
+    if (rename(_tmp_path.c_str(), _path.c_str()) == -1) {
+        unlink(_tmp_path.c_str());
+        throw HTTP_INTERNAL_SERVER_ERROR;
+    }
+    _v_stored.push_back(_name);
+}
+
+}  // namespace core
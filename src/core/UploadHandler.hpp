@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../http/Request.hpp"
+#include "ByteBuffer.hpp"
+
+namespace core {
+
+// Stores the body of a PUT or the file parts of a multipart/form-data POST in the upload_store of
+// a location while the body arrives. Every file is written to a temp file next to its final name
+// and only renamed once it is complete, so a broken upload never shows up in the store.
+class UploadHandler {
+   private:
+    enum State { PART_DATA, PART_AFTER_DELIMITER, PART_HEADER, PART_END };
+
+    std::string              _store;
+    std::string              _delimiter;  // CRLF "--" boundary, empty for a PUT
+    State                    _state;
+    std::string              _pending;  // unparsed bytes, at most a delimiter or part header
+    int                      _fd;
+    std::string              _tmp_path;
+    std::string              _path;
+    std::string              _name;
+    bool                     _is_created;
+    std::vector<std::string> _v_stored;
+
+    void _parse_multipart();
+    void _parse_part_header(const std::string &header);
+    void _open_file(const std::string &name, size_t len);
+    void _write(const char *data, size_t len);
+    void _store_file();
+
+   public:
+    UploadHandler();
+    UploadHandler(const UploadHandler &other);
+    ~UploadHandler();
+
+    void start(const http::Request &req);
+    void write(ByteBuffer &body);
+    void finish();
+    void abort();
+
+    bool                            is_created() const;
+    const std::vector<std::string> &v_stored() const;
+};
+
+}  // namespace core
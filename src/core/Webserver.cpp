@@ -3,7 +3,9 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
 #include <string>
 
 #include "../utils/color.hpp"
@@ -13,12 +15,33 @@
 
 namespace core {
 
-Webserver::Webserver(const std::vector<config::Server> &v_server)
-    : _eni(_m_socket),
-      _v_server(v_server),
-      _used_connections(0),
-      _max_connections(MAX_CONNECTIONS) {
-    _v_connection.resize(_max_connections);
+Webserver::Webserver(const config::Global &global, const std::vector<config::Server> &v_server,
+                     const CgiSpawner &cgi_spawner, bool reuse_port)
+    : _open_file_cache(global.open_file_cache, global.open_file_cache_valid,
+                       global.open_file_cache_errors),
+      _response_cache(global.response_cache_entries, global.response_cache_size),
+      _listing_cache(LISTING_CACHE_ENTRIES, LISTING_CACHE_SIZE),
+      _fastcgi_pool(global.fastcgi_keepalive),
+      _v_connection(MAX_CONNECTIONS),
+      _global(global),
+      _v_server(v_server) {
+    // Free connections are taken from the back, so the first ones are used first
+    _v_free_connection.reserve(MAX_CONNECTIONS);
+    for (std::vector<Connection>::reverse_iterator it = _v_connection.rbegin();
+         it != _v_connection.rend(); ++it) {
+        it->set_caches(&_open_file_cache, &_response_cache, &_listing_cache);
+        it->set_cgi_splice(global.cgi_splice);
+        it->set_cgi_output_buffer_size(global.cgi_output_buffer_size);
+        it->set_cgi_spawner(&cgi_spawner);
+        it->set_fastcgi_pool(&_fastcgi_pool);
+        it->set_cgi_pool(&_cgi_pool);
+        it->set_client_body_temp_path(global.client_body_temp_path);
+        _v_free_connection.push_back(&*it);
+    }
+
+    _cgi_pool.set_cgi_spawner(&cgi_spawner);
+    for (size_t i = 0; i < _v_server.size(); i++)
+        _add_cgi_pools(_v_server[i].v_location);
 
     // Create sockets
     typedef std::vector<config::Server>::const_iterator server_it_t;
@@ -31,8 +54,10 @@ Webserver::Webserver(const std::vector<config::Server> &v_server)
             if (std::find(v_added_listens.begin(), v_added_listens.end(), *it_listen) ==
                 v_added_listens.end()) {
                 v_added_listens.push_back(*it_listen);
-                Socket socket(it_listen->addr, it_listen->port);
-                _m_socket.insert(std::make_pair(socket.fd(), socket));
+                Socket socket(it_listen->addr, it_listen->port, reuse_port);
+                std::map<int, Socket>::iterator it_socket =
+                    _m_socket.insert(std::make_pair(socket.fd(), socket)).first;
+                _eni.add_socket_fd(socket.fd(), &it_socket->second);
                 _eni.add_event(socket.fd(), EVFILT_READ);
             }
         }
@@ -41,6 +66,18 @@ Webserver::Webserver(const std::vector<config::Server> &v_server)
 
 Webserver::~Webserver() {}
 
+// Every event loop starts its own workers for the cgi_pool passes of all locations
+void Webserver::_add_cgi_pools(const std::vector<config::Location> &v_location) {
+    for (size_t i = 0; i < v_location.size(); i++) {
+        const config::Location &location = v_location[i];
+        for (size_t j = 0; j < location.v_cgi_pass.size(); j++) {
+            if (location.v_cgi_pass[j].pool_workers > 0)
+                _cgi_pool.add(location.v_cgi_pass[j], location.root);
+        }
+        _add_cgi_pools(location.v_location);
+    }
+}
+
 void Webserver::run() {
 #if PRINT_LEVEL > 0
     std::cout << utils::COLOR_CY_1 << "Webserver running! 🚀" << utils::COLOR_NO << std::endl;
@@ -52,20 +89,29 @@ void Webserver::run() {
                 throw std::runtime_error("poll_events: " + std::string(strerror(errno)));
             for (int i = 0; i < num_events; i++) {
                 try {
-                    // Kevent error
+                    // Event went stale while handling the current batch
+                    if (_eni.events[i].filter == EVFILT_NONE)
+                        continue;
+
+                    // Kevent error, changes for fds closed before the poll are expected to fail
                     if (_eni.events[i].flags & EV_ERROR) {
-                        throw std::runtime_error("kevent: " + std::string(strerror(errno)));
+                        if (_eni.events[i].data == EBADF || _eni.events[i].data == ENOENT)
+                            continue;
+                        throw std::runtime_error("kevent: " +
+                                                 std::string(strerror(_eni.events[i].data)));
                     }
 
+                    int fd = _eni.events[i].ident;
+
                     // New connection on listen socket
-                    const core::Socket *socket = _eni.find_socket(_eni.events[i].ident);
+                    const core::Socket *socket = _eni.find_socket(fd);
                     if (socket) {
-                        _accept_connection(*socket);
+                        _accept_connections(*socket);
                         continue;
                     }
 
                     // New event on cgi fd
-                    core::CgiHandler *cgi = _eni.find_cgi(_eni.events[i].ident);
+                    core::CgiHandler *cgi = _eni.find_cgi(fd);
                     if (cgi) {
                         if (_eni.events[i].filter == EVFILT_READ) {
                             if (_eni.events[i].data <= 0 && _eni.events[i].flags & EV_EOF) {
@@ -82,19 +128,22 @@ void Webserver::run() {
                     }
 
                     // Event on established connection
+                    core::Connection *connection = _eni.find_connection(fd);
+                    if (!connection)
+                        continue;
                     if (_eni.events[i].filter == EVFILT_TIMER) {
-                        _timeout_connection(_eni.events[i].ident);
+                        _timeout_connection(*connection);
                     } else if (_eni.events[i].filter == EVFILT_READ) {
                         if (_eni.events[i].data <= 0 && _eni.events[i].flags & EV_EOF) {
-                            _close_connection(_eni.events[i].ident);
+                            _close_connection(*connection);
                         } else if (_eni.events[i].data > 0) {
-                            _receive(_eni.events[i].ident, _eni.events[i].data);
+                            _receive(*connection, _eni.events[i].data);
                         }
                     } else if (_eni.events[i].filter == EVFILT_WRITE) {
                         if (_eni.events[i].flags & EV_EOF) {
-                            _close_connection(_eni.events[i].ident);
+                            _close_connection(*connection);
                         } else if (_eni.events[i].data > 0) {
-                            _send(_eni.events[i].ident, _eni.events[i].data);
+                            _send(*connection, _eni.events[i].data);
                         }
                     }
                 } catch (const std::exception &e) {
@@ -123,137 +172,160 @@ void Webserver::run() {
     }
 }
 
-void Webserver::_accept_connection(const Socket &socket) {
+// Drains the backlog of a listen socket, up to multi_accept connections per event
+void Webserver::_accept_connections(const Socket &socket) {
+    for (uint32_t i = 0; i < _global.multi_accept; i++) {
+        if (!_accept_connection(socket))
+            break;
+    }
+}
+
+bool Webserver::_accept_connection(const Socket &socket) {
     struct ::sockaddr_in accept_addr;
     socklen_t            accept_addr_len = sizeof(::sockaddr_in);
     Address              client_addr;
 
+#if defined(__linux__)
+    int accept_fd = accept4(socket.fd(), (struct sockaddr *)&accept_addr, &accept_addr_len,
+                            SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
     int accept_fd = ::accept(socket.fd(), (struct sockaddr *)&accept_addr, &accept_addr_len);
+#endif
     if (accept_fd == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return false;
+        // The client gave up before it was accepted
+        if (errno == ECONNABORTED || errno == EINTR)
+            return true;
         throw std::runtime_error("accept: " + std::string(strerror(errno)));
     }
 
-    if (fcntl(accept_fd, F_SETFL, O_NONBLOCK) == -1) {
+#if !defined(__linux__)
+    if (fcntl(accept_fd, F_SETFL, O_NONBLOCK) == -1 ||
+        fcntl(accept_fd, F_SETFD, FD_CLOEXEC) == -1) {
         close(accept_fd);
         throw std::runtime_error("fcntl: " + std::string(strerror(errno)));
     }
+#endif
 
+#ifdef SO_NOSIGPIPE
     int optval = 1;
     if (setsockopt(accept_fd, SOL_SOCKET, SO_NOSIGPIPE, &optval, sizeof(optval)) < 0) {
         close(accept_fd);
         throw std::runtime_error("setsockopt: " + std::string(strerror(errno)));
     }
+#endif
 
     client_addr.addr = accept_addr.sin_addr.s_addr;
     client_addr.port = accept_addr.sin_port;
 
-    int error =
-        (_eni.add_timer(accept_fd, CONN_TIMEOUT_TIME) || _eni.add_event(accept_fd, EVFILT_READ) ||
-         _eni.add_event(accept_fd, EVFILT_WRITE) || _eni.disable_event(accept_fd, EVFILT_WRITE));
-
-    if (error) {
-        _eni.delete_event(accept_fd, EVFILT_TIMER);
-        _eni.delete_event(accept_fd, EVFILT_READ);
-        _eni.delete_event(accept_fd, EVFILT_WRITE);
-        close(accept_fd);
-        throw std::runtime_error("eni: " + std::string(strerror(errno)));
-    }
-
-    if (_used_connections >= _max_connections) {
+    // All connections are in use, an idle one is closed to make room
+    if (_v_free_connection.empty()) {
         for (std::vector<Connection>::iterator it = _v_connection.begin();
              it != _v_connection.end(); ++it) {
             if (!it->is_active()) {
-                _close_connection(it);
-                it->init(accept_fd, client_addr, socket.addr());
-                return;
+                _close_connection(*it);
+                break;
             }
         }
-        _eni.delete_event(accept_fd, EVFILT_TIMER);
-        _eni.delete_event(accept_fd, EVFILT_READ);
-        _eni.delete_event(accept_fd, EVFILT_WRITE);
+    }
+    if (_v_free_connection.empty()) {
         close(accept_fd);
         throw std::runtime_error("connection limit reached");
-    } else {
-        std::vector<Connection>::iterator it =
-            std::find(_v_connection.begin(), _v_connection.end(), -1);
-        it->init(accept_fd, client_addr, socket.addr());
-        _used_connections++;
     }
+
+    Connection *connection = _v_free_connection.back();
+    _v_free_connection.pop_back();
+    connection->init(accept_fd, client_addr, socket.addr());
+    if (_eni.add_connection_fd(accept_fd, connection, CONN_TIMEOUT_TIME)) {
+        _close_connection(*connection);
+        throw std::runtime_error("eni: " + std::string(strerror(errno)));
+    }
+    return true;
 }
 
-void Webserver::_receive(int fd, size_t data_len) {
-    std::vector<Connection>::iterator conn_it =
-        std::find(_v_connection.begin(), _v_connection.end(), fd);
+void Webserver::_receive(Connection &connection, size_t data_len) {
+    int fd = connection.fd();
 
     try {
-        conn_it->receive(data_len);
+        if (connection.receive(data_len) == 0) {
+            _close_connection(connection);
+            return;
+        }
         if (_eni.add_timer(fd, CONN_TIMEOUT_TIME))
             throw std::runtime_error("eni: " + std::string(strerror(errno)));
-        conn_it->parse_request(_v_server);
-        if (conn_it->is_request_done()) {
+        connection.parse_request(_v_server);
+        if (connection.is_request_done()) {
             if (_eni.disable_event(fd, EVFILT_READ) || _eni.enable_event(fd, EVFILT_WRITE)) {
                 throw std::runtime_error("eni: " + std::string(strerror(errno)));
             }
-            conn_it->build_response(_eni);
+            connection.build_response(_eni);
+        } else if (connection.is_header_done()) {
+            // The response starts before the body is complete, so a CGI reads it as it arrives
+            connection.build_response(_eni);
+            // An upload that fails while its body arrives is answered right away
+            if (connection.is_request_done() &&
+                (_eni.disable_event(fd, EVFILT_READ) || _eni.enable_event(fd, EVFILT_WRITE))) {
+                throw std::runtime_error("eni: " + std::string(strerror(errno)));
+            }
         }
     } catch (...) {
-        _close_connection(conn_it);
+        _close_connection(connection);
         throw;
     }
 }
 
-void Webserver::_send(int fd, size_t max_len) {
-    std::vector<Connection>::iterator it =
-        std::find(_v_connection.begin(), _v_connection.end(), fd);
+void Webserver::_send(Connection &connection, size_t max_len) {
+    int fd = connection.fd();
+
     try {
-        if (it->send_response(_eni, max_len)) {
+        if (connection.send_response(_eni, max_len)) {
             if (_eni.add_timer(fd, CONN_TIMEOUT_TIME))
                 throw std::runtime_error("eni: " + std::string(strerror(errno)));
         }
-        if (it->is_response_done()) {
-            if (it->should_close()) {
-                _close_connection(it);
+        if (connection.is_response_done()) {
+            // A CGI may answer before it read the whole body, the rest of it is not waited for
+            if (connection.should_close() || !connection.is_request_done()) {
+                _close_connection(connection);
                 return;
             }
-            it->reinit();
-            it->parse_request(_v_server);
-            if (it->is_request_done()) {
-                it->build_response(_eni);
+            connection.reinit();
+            connection.parse_request(_v_server);
+            if (connection.is_request_done()) {
+                connection.build_response(_eni);
                 return;
             }
 
-            if (_eni.disable_event(it->fd(), EVFILT_WRITE) ||
-                _eni.enable_event(it->fd(), EVFILT_READ)) {
+            if (_eni.disable_event(fd, EVFILT_WRITE) || _eni.enable_event(fd, EVFILT_READ)) {
                 throw std::runtime_error("eni: " + std::string(strerror(errno)));
             }
         }
     } catch (...) {
-        _close_connection(it);
+        _close_connection(connection);
         throw;
     }
 }
 
 void Webserver::_close_connection(int fd) {
-    std::vector<Connection>::iterator it =
-        std::find(_v_connection.begin(), _v_connection.end(), fd);
-    if (it != _v_connection.end()) {
-        _close_connection(it);
+    Connection *connection = _eni.find_connection(fd);
+    if (connection) {
+        _close_connection(*connection);
     }
 }
 
-void Webserver::_close_connection(std::vector<Connection>::iterator it) {
-    _eni.delete_event(it->fd(), EVFILT_TIMER);
-    _eni.delete_event(it->fd(), EVFILT_READ);
-    _eni.delete_event(it->fd(), EVFILT_WRITE);
-    it->destroy(_eni);
-    _used_connections--;
+void Webserver::_close_connection(Connection &connection) {
+    if (connection.fd() == -1)
+        return;
+    _eni.remove_connection_fd(connection.fd());
+    connection.destroy(_eni);
+    _v_free_connection.push_back(&connection);
 }
 
-void Webserver::_timeout_connection(int fd) {
+void Webserver::_timeout_connection(Connection &connection) {
 #if PRINT_LEVEL > 0
     std::cout << utils::COLOR_CY << "[Timeout] " << utils::COLOR_NO;
 #endif
-    _close_connection(fd);
+    _close_connection(connection);
 }
 
 }  // namespace core
@@ -2,33 +2,47 @@
 
 #include <vector>
 
+#include "../config/Global.hpp"
 #include "../config/Server.hpp"
 #include "../settings.hpp"
+#include "CgiPool.hpp"
+#include "CgiSpawner.hpp"
 #include "Connection.hpp"
 #include "EventNotificationInterface.hpp"
+#include "FastCgiPool.hpp"
+#include "OpenFileCache.hpp"
+#include "ResponseCache.hpp"
 #include "Socket.hpp"
 
 namespace core {
 
 class Webserver {
    private:
+    std::map<int, Socket>              _m_socket;
+    OpenFileCache                      _open_file_cache;
+    ResponseCache                      _response_cache;
+    ResponseCache                      _listing_cache;
+    FastCgiPool                        _fastcgi_pool;
+    CgiPool                            _cgi_pool;
     std::vector<Connection>            _v_connection;
+    std::vector<Connection *>          _v_free_connection;
     EventNotificationInterface         _eni;
+    const config::Global              &_global;
     const std::vector<config::Server> &_v_server;
-    size_t                             _used_connections;
-    const size_t                       _max_connections;
-    std::map<int, Socket>              _m_socket;
 
-    void _accept_connection(const Socket &socket);
+    void _accept_connections(const Socket &socket);
+    bool _accept_connection(const Socket &socket);
     void _close_connection(int fd);
-    void _close_connection(std::vector<Connection>::iterator it);
-    void _timeout_connection(int fd);
+    void _close_connection(Connection &connection);
+    void _timeout_connection(Connection &connection);
+    void _add_cgi_pools(const std::vector<config::Location> &v_location);
 
-    void _receive(int fd, size_t data_len);
-    void _send(int fd, size_t max_len);
+    void _receive(Connection &connection, size_t data_len);
+    void _send(Connection &connection, size_t max_len);
 
    public:
-    Webserver(const std::vector<config::Server> &v_server);
+    Webserver(const config::Global &global, const std::vector<config::Server> &v_server,
+              const CgiSpawner &cgi_spawner, bool reuse_port = false);
     ~Webserver();
 
     void run();
@@ -1,5 +1,11 @@
 #include "Request.hpp"
 
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+
 #include "../core/Address.hpp"
 #include "../http/status_codes.hpp"
 #include "../settings.hpp"
@@ -22,6 +28,8 @@
 
 namespace http {
 
+const size_t Request::RANGE_NONE;
+
 Request::Request()
     : _state(REQUEST_LINE),
       _state_request_line(RL_START),
@@ -30,9 +38,13 @@ Request::Request()
       _info_len(0),
       _chunk_len(0),
       _method(NONE),
+      _accepted_encodings(0),
       _body_content_type(CONT_NONE),
       _content_len(0),
+      _body_len(0),
       _body(NULL),
+      _body_fd(-1),
+      _body_temp_path(CLIENT_BODY_TEMP_PATH),
       _connection(CONN_KEEP_ALIVE),
       _server(NULL),
       _location(NULL),
@@ -47,7 +59,10 @@ Request::Request()
     _value.reserve(MAX_INFO_LEN / 4);
 }
 
-Request::~Request() { delete _body; }
+Request::~Request() {
+    delete _body;
+    _close_body_file();
+}
 
 void Request::init() {
     _state = REQUEST_LINE;
@@ -59,6 +74,7 @@ void Request::init() {
     _method = NONE;
     _body_content_type = CONT_NONE;
     _content_len = 0;
+    _body_len = 0;
     _connection = CONN_KEEP_ALIVE;
     _server = NULL;
     _location = NULL;
@@ -71,10 +87,15 @@ void Request::init() {
     _key.clear();
     _value.clear();
     _m_header.clear();
+    _accepted_encodings = 0;
+    _v_range.clear();
     delete _body;
     _body = new core::ByteBuffer(1024);
+    _close_body_file();
 }
 
+void Request::set_body_temp_path(const std::string &path) { _body_temp_path = path; }
+
 bool Request::parse(const char *buf, size_t buf_len, size_t &buf_pos,
                     const std::vector<config::Server> &v_server, const core::Address &socket_addr) {
     if (_state == REQUEST_LINE) {
@@ -95,7 +116,6 @@ bool Request::parse(const char *buf, size_t buf_len, size_t &buf_pos,
             throw HTTP_CONTENT_TOO_LARGE;
         switch (_body_content_type) {
             case CONT_LENGTH:
-                _body->reserve(_content_len);
                 _state = BODY;
                 break;
             case CONT_CHUNKED:
@@ -107,11 +127,12 @@ bool Request::parse(const char *buf, size_t buf_len, size_t &buf_pos,
         }
     }
     if (_state == BODY) {
-        size_t left_len = _content_len - _body->size();
+        size_t left_len = _content_len - _body_len;
         if (left_len > buf_len - buf_pos)
             left_len = buf_len - buf_pos;
-        _body->append(buf + buf_pos, left_len);
-        if (_body->size() != _content_len)
+        _append_body(buf + buf_pos, left_len);
+        buf_pos += left_len;
+        if (_body_len != _content_len)
             return false;
         _state = DONE;
     }
@@ -123,6 +144,7 @@ bool Request::parse(const char *buf, size_t buf_len, size_t &buf_pos,
     if (_state == DONE) {
         if (_method == GET || _method == HEAD) {
             _body->clear();
+            _close_body_file();
             _body_content_type = CONT_NONE;
         }
 #if PRINT_LEVEL > 1
@@ -337,6 +359,7 @@ bool Request::_parse_request_line(const char *buf, size_t buf_len, size_t &buf_p
                         break;
                     case '#':
                         _state_request_line = RL_URI_FRAGMENT;
+                        break;
                     default:
                         if (!isprint(c))
                             throw HTTP_BAD_REQUEST;
@@ -463,8 +486,10 @@ void Request::_parse_method() {
                 _method = Request::GET;
                 return;
             }
-            if (_method_str == "PUT")
-                throw HTTP_NOT_IMPLEMENTED;
+            if (_method_str == "PUT") {
+                _method = Request::PUT;
+                return;
+            }
             break;
         case 4:
             if (_method_str == "HEAD") {
@@ -629,12 +654,114 @@ void Request::_analyze_header() {
             if (it->second == "close") {
                 _connection = CONN_CLOSE;
             }
+        } else if (it->first == "ACCEPT-ENCODING") {
+            _parse_accept_encoding(it->second);
+        } else if (it->first == "RANGE") {
+            _parse_range(it->second);
         }
     }
     if (!host_found)
         throw HTTP_BAD_REQUEST;
 }
 
+static std::string trim_whitespace(const std::string &str) {
+    size_t start = str.find_first_not_of(" \t");
+    if (start == std::string::npos)
+        return "";
+    return str.substr(start, str.find_last_not_of(" \t") - start + 1);
+}
+
+// A coding with "q=0" is explicitly refused, any other weight accepts it
+static bool is_refused(const std::string &params) {
+    size_t start = 0;
+    while (start < params.size()) {
+        size_t      end = params.find(';', start);
+        std::string param = trim_whitespace(params.substr(start, end - start));
+        if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+            std::string weight = trim_whitespace(param.substr(2));
+            return weight.size() > 0 && weight[0] == '0' &&
+                   weight.find_first_not_of("0.", 1) == std::string::npos;
+        }
+        if (end == std::string::npos)
+            break;
+        start = end + 1;
+    }
+    return false;
+}
+
+// Only the codings the server can send matter, "*" stands for every coding not listed
+void Request::_parse_accept_encoding(const std::string &value) {
+    unsigned accepted = 0;
+    unsigned refused = 0;
+    bool     is_wildcard = false;
+
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos)
+            end = value.size();
+        std::string element = value.substr(start, end - start);
+        size_t      params_start = element.find(';');
+        std::string coding = trim_whitespace(element.substr(0, params_start));
+        bool        is_coding_refused =
+            params_start != std::string::npos && is_refused(element.substr(params_start + 1));
+        std::transform(coding.begin(), coding.end(), coding.begin(), ::tolower);
+
+        unsigned encoding = 0;
+        if (coding == "gzip" || coding == "x-gzip")
+            encoding = ENCODING_GZIP;
+        else if (coding == "br")
+            encoding = ENCODING_BR;
+        else if (coding == "*")
+            is_wildcard = !is_coding_refused;
+        if (is_coding_refused)
+            refused |= encoding;
+        else
+            accepted |= encoding;
+        start = end + 1;
+    }
+    if (is_wildcard)
+        accepted |= ENCODING_GZIP | ENCODING_BR;
+    _accepted_encodings = accepted & ~refused;
+}
+
+// Byte ranges of a Range header. A header that is not understood or asks for too many ranges is
+// ignored, the whole file is sent then.
+void Request::_parse_range(const std::string &value) {
+    _v_range.clear();
+    if (value.size() < 6 || strncasecmp(value.c_str(), "bytes=", 6) != 0)
+        return;
+
+    size_t start = 6;
+    while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos)
+            end = value.size();
+        std::string spec = trim_whitespace(value.substr(start, end - start));
+        start = end + 1;
+        if (spec.size() == 0)
+            continue;
+
+        size_t dash_pos = spec.find('-');
+        if (dash_pos == std::string::npos) {
+            _v_range.clear();
+            return;
+        }
+        ByteRange   range = {RANGE_NONE, RANGE_NONE};
+        std::string first = trim_whitespace(spec.substr(0, dash_pos));
+        std::string last = trim_whitespace(spec.substr(dash_pos + 1));
+        if ((first.size() == 0 && last.size() == 0) ||
+            (first.size() > 0 && !utils::str_to_num_dec(first, range.first)) ||
+            (last.size() > 0 && !utils::str_to_num_dec(last, range.last)) ||
+            (first.size() > 0 && last.size() > 0 && range.first > range.last) ||
+            _v_range.size() == MAX_RANGES) {
+            _v_range.clear();
+            return;
+        }
+        _v_range.push_back(range);
+    }
+}
+
 void Request::_find_server(const std::vector<config::Server> &v_server,
                            const core::Address               &socket_addr) {
     typedef std::vector<config::Server>::const_iterator const_server_it;
@@ -841,7 +968,7 @@ bool Request::_parse_body_chunked(const char *buf, size_t buf_len, size_t &buf_p
                         if (!isxdigit(c))
                             throw HTTP_BAD_REQUEST;
                         _chunk_len = _chunk_len * 16 + HEX_CHAR_TO_INT(c);
-                        if (_body->size() + _chunk_len > _location->client_max_body_size)
+                        if (_body_len + _chunk_len > _location->client_max_body_size)
                             throw HTTP_CONTENT_TOO_LARGE;
                         break;
                 }
@@ -865,8 +992,13 @@ bool Request::_parse_body_chunked(const char *buf, size_t buf_len, size_t &buf_p
                 break;
             case BC_DATA:
                 if (_chunk_len > 0) {
-                    _body += c;
-                    _chunk_len--;
+                    // The data of a chunk is taken in one piece, the loop steps past its end
+                    size_t data_len = buf_len - buf_pos;
+                    if (data_len > _chunk_len)
+                        data_len = _chunk_len;
+                    _append_body(buf + buf_pos, data_len);
+                    _chunk_len -= data_len;
+                    buf_pos += data_len - 1;
                     break;
                 }
                 switch (c) {
@@ -930,6 +1062,47 @@ bool Request::_parse_body_chunked(const char *buf, size_t buf_len, size_t &buf_p
     return false;
 }
 
+// Buffered bodies move to a temp file once they outgrow the buffer. The file is unlinked right
+// away, so it is gone with the last fd and nothing is left behind after a crash.
+void Request::_append_body(const char *data, size_t len) {
+    _body_len += len;
+    if (_body_fd == -1 &&
+        (!is_body_buffered() || _body_len <= _location->client_body_buffer_size)) {
+        _body->append(data, len);
+        return;
+    }
+    if (_body_fd == -1) {
+        std::string path = _body_temp_path + "/webserv_body_XXXXXX";
+        _body_fd = mkstemp(&path[0]);
+        if (_body_fd == -1)
+            throw HTTP_INTERNAL_SERVER_ERROR;
+        unlink(path.c_str());
+        fcntl(_body_fd, F_SETFD, FD_CLOEXEC);
+        if (!_body->empty())
+            _write_body_file(&(*_body)[0], _body->size());
+        _body->clear();
+        _body->set_pos(0);
+    }
+    _write_body_file(reinterpret_cast<const uint8_t *>(data), len);
+}
+
+void Request::_write_body_file(const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(_body_fd, data, len);
+        if (written == -1)
+            throw HTTP_INTERNAL_SERVER_ERROR;
+        data += written;
+        len -= written;
+    }
+}
+
+void Request::_close_body_file() {
+    if (_body_fd == -1)
+        return;
+    close(_body_fd);
+    _body_fd = -1;
+}
+
 void Request::print() const {
     typedef std::map<std::string, std::string>::const_iterator const_header_it;
     std::cout
@@ -965,6 +1138,24 @@ void Request::print() const {
 
 bool Request::connection_should_close() const { return _connection == CONN_CLOSE; }
 
+bool Request::accepts_encoding(Encoding encoding) const { return _accepted_encodings & encoding; }
+
+bool Request::is_header_done() const { return _state != REQUEST_LINE && _state != HEADER; }
+
+bool Request::is_done() const { return _state == DONE; }
+
+// Bodies of GET and HEAD requests are read but never passed on
+bool Request::has_body() const {
+    return _body_content_type != CONT_NONE && _method != GET && _method != HEAD;
+}
+
+// Without a client_body_buffer_size the body is streamed, otherwise it is read completely first.
+// An upload store always takes the body while it arrives.
+bool Request::is_body_buffered() const {
+    return _location && _location->client_body_buffer_size != SIZE_MAX &&
+           _location->upload_store.empty();
+}
+
 Request::Method Request::method() const { return _method; }
 
 const std::string &Request::method_str() const { return _method_str; }
@@ -987,8 +1178,16 @@ const config::Server *Request::server() const { return _server; }
 
 const config::Location *Request::location() const { return _location; }
 
+core::ByteBuffer &Request::body() { return *_body; }
+
 const core::ByteBuffer &Request::body() const { return *_body; }
 
+int Request::body_fd() const { return _body_fd; }
+
+size_t Request::content_len() const { return _content_len; }
+
+const std::vector<Request::ByteRange> &Request::v_range() const { return _v_range; }
+
 const std::string &Request::relative_path() const { return _relative_path; }
 
 const std::string &Request::absolute_path() const { return _absolute_path; }
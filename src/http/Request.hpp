@@ -1,7 +1,10 @@
 #pragma once
 
+#include <stdint.h>
+
 #include <map>
 #include <string>
+#include <vector>
 
 #include "../config/Location.hpp"
 #include "../config/Server.hpp"
@@ -12,7 +15,16 @@ namespace http {
 
 class Request {
    public:
-    enum Method { NONE, GET, POST, DELETE, HEAD };
+    enum Method { NONE, GET, POST, DELETE, HEAD, PUT };
+    enum Encoding { ENCODING_GZIP = 1, ENCODING_BR = 2 };
+
+    // Inclusive byte positions of a Range header. A suffix range ("-500") has no first, an open
+    // range ("9500-") has no last, both are resolved against the file size by the response.
+    struct ByteRange {
+        size_t first;
+        size_t last;
+    };
+    static const size_t RANGE_NONE = SIZE_MAX;
 
    private:
     enum State { REQUEST_LINE, HEADER, BODY, BODY_CHUNKED, DONE };
@@ -97,11 +109,17 @@ class Request {
     std::string                        _key;
     std::string                        _value;
     std::map<std::string, std::string> _m_header;
+    unsigned                           _accepted_encodings;
+    std::vector<ByteRange>             _v_range;
 
-    // Body
+    // Body, the buffer only holds the part a consumer has not taken yet. A buffered body larger
+    // than client_body_buffer_size is kept in an unlinked temp file instead.
     BodyContentType   _body_content_type;
     size_t            _content_len;
+    size_t            _body_len;
     core::ByteBuffer *_body;
+    int               _body_fd;
+    std::string       _body_temp_path;
 
     // Other
     Connection              _connection;  // naming ??! same as connection from webserver
@@ -119,12 +137,17 @@ class Request {
     bool _parse_header(const char *buf, size_t buf_len, size_t &buf_pos);
     void _add_header();
     void _analyze_header();
+    void _parse_accept_encoding(const std::string &value);
+    void _parse_range(const std::string &value);
     void _find_server(const std::vector<config::Server> &v_server,
                       const core::Address               &socket_addr);
     void _find_location();
     void _check_method();
     void _process_path();
     bool _parse_body_chunked(const char *buf, size_t buf_len, size_t &buf_pos);
+    void _append_body(const char *data, size_t len);
+    void _write_body_file(const uint8_t *data, size_t len);
+    void _close_body_file();
     bool _finalize();
 
    public:
@@ -132,11 +155,17 @@ class Request {
     ~Request();
 
     void init();
+    void set_body_temp_path(const std::string &path);
     bool parse(const char *buf, size_t buf_len, size_t &buf_pos,
                const std::vector<config::Server> &v_server, const core::Address &socket_addr);
     void print() const;
 
     bool connection_should_close() const;
+    bool accepts_encoding(Encoding encoding) const;
+    bool is_header_done() const;
+    bool is_done() const;
+    bool has_body() const;
+    bool is_body_buffered() const;
 
     // GETTERS
     Method                                    method() const;
@@ -150,7 +179,11 @@ class Request {
     const std::map<std::string, std::string> &m_header() const;
     const config::Server                     *server() const;
     const config::Location                   *location() const;
+    core::ByteBuffer                         &body();
     const core::ByteBuffer                   &body() const;
+    int                                       body_fd() const;
+    size_t                                    content_len() const;
+    const std::vector<ByteRange>             &v_range() const;
     const std::string                        &relative_path() const;
     const std::string                        &absolute_path() const;
 };
@@ -1,22 +1,55 @@
 #include "Response.hpp"
 
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
 #include "../utils/color.hpp"
+#include "../utils/html_escape.hpp"
+#include "../utils/http_date.hpp"
 #include "../utils/num_to_str.hpp"
+#include "../utils/str_to_num.hpp"
 #include "Request.hpp"
 #include "mime_types.hpp"
 #include "status_codes.hpp"
 
 namespace http {
 
-void Response::_construct_header_file(const Request &req) {
+void Response::_construct_header_file(const Request &req, int status_code) {
+    size_t content_len = _file_handler.max_size();
+
     _header.append("HTTP/1.1 ");
-    _header.append(g_m_status_codes.find(200)->second.c_str());
+    _header.append(g_m_status_codes.find(status_code)->second.c_str());
     _header.append("\r\nServer: ");
     _header.append(SERVER_NAME);
     _header.append("\r\nContent-Type: ");
-    _header.append(mime_type(_file_handler.path()));
+    if (_boundary.empty()) {
+        _header.append(_content_type);
+    } else {
+        _header.append("multipart/byteranges; boundary=");
+        _header.append(_boundary.c_str());
+    }
+    if (_content_encoding) {
+        _header.append("\r\nContent-Encoding: ");
+        _header.append(_content_encoding);
+    }
+    if (req.location()->gzip_static)
+        _header.append("\r\nVary: Accept-Encoding");
+    _append_cache_header(req);
+    _header.append("\r\nAccept-Ranges: bytes");
+    if (status_code == HTTP_PARTIAL_CONTENT && _boundary.empty()) {
+        content_len = _v_range[0].last - _v_range[0].first + 1;
+        _header.append("\r\nContent-Range: ");
+        _header.append(_content_range(_v_range[0]).c_str());
+    } else if (status_code == HTTP_PARTIAL_CONTENT) {
+        content_len = _multipart_len();
+    }
     _header.append("\r\nContent-Length: ");
-    _header.append(utils::num_to_str_dec(_file_handler.max_size()).c_str());
+    _header.append(utils::num_to_str_dec(content_len).c_str());
     _header.append("\r\nConnection: ");
     if (req.connection_should_close())
         _header.append("close");
@@ -25,6 +58,10 @@ void Response::_construct_header_file(const Request &req) {
     _header.append("\r\n\r\n");
     if (req.method() == Request::HEAD || _file_handler.max_size() == 0)
         _file_handler.close();
+    else if (status_code == HTTP_PARTIAL_CONTENT && _boundary.empty())
+        _file_handler.set_range(_v_range[0].first, content_len);
+    else if (status_code == HTTP_PARTIAL_CONTENT)
+        next_range_part();
 }
 
 void Response::_construct_header_cgi(const Request &req) {
@@ -40,6 +77,320 @@ void Response::_construct_header_cgi(const Request &req) {
         _header.append("keep-alive\r\n");
 }
 
+// A revalidated file is answered with its validators only, the body stays unread
+void Response::_construct_header_not_modified(const Request &req) {
+    _header.append("HTTP/1.1 ");
+    _header.append(g_m_status_codes.find(HTTP_NOT_MODIFIED)->second.c_str());
+    _header.append("\r\nServer: ");
+    _header.append(SERVER_NAME);
+    if (req.location()->gzip_static)
+        _header.append("\r\nVary: Accept-Encoding");
+    _append_cache_header(req);
+    _header.append("\r\nConnection: ");
+    if (req.connection_should_close())
+        _header.append("close");
+    else
+        _header.append("keep-alive");
+    _header.append("\r\n\r\n");
+    _file_handler.close();
+}
+
+// Validators of the file and what the location allows caches to do with it
+void Response::_append_cache_header(const Request &req) {
+    const config::Location *location = req.location();
+    time_t                  now = time(NULL);
+
+    _header.append("\r\nETag: ");
+    _header.append(_etag.c_str());
+    _header.append("\r\nLast-Modified: ");
+    _header.append(utils::http_date(_file_handler.mtime()).c_str());
+    switch (location->expires) {
+        case config::Location::EXPIRES_OFF:
+            break;
+        case config::Location::EXPIRES_TIME:
+            _header.append("\r\nExpires: ");
+            _header.append(utils::http_date(now + location->expires_time).c_str());
+            if (location->cache_control.size() > 0)
+                break;
+            if (location->expires_time < 0) {
+                _header.append("\r\nCache-Control: no-cache");
+            } else {
+                _header.append("\r\nCache-Control: max-age=");
+                _header.append(utils::num_to_str_dec(location->expires_time).c_str());
+            }
+            break;
+        case config::Location::EXPIRES_EPOCH:
+            _header.append("\r\nExpires: Thu, 01 Jan 1970 00:00:01 GMT");
+            if (location->cache_control.size() == 0)
+                _header.append("\r\nCache-Control: no-cache");
+            break;
+        case config::Location::EXPIRES_MAX:
+            _header.append("\r\nExpires: Thu, 31 Dec 2037 23:55:55 GMT");
+            if (location->cache_control.size() == 0) {
+                _header.append("\r\nCache-Control: max-age=");
+                _header.append(utils::num_to_str_dec(EXPIRES_MAX_TIME).c_str());
+            }
+            break;
+    }
+    if (location->cache_control.size() > 0) {
+        _header.append("\r\nCache-Control: ");
+        _header.append(location->cache_control.c_str());
+    }
+}
+
+// Serves file.br or file.gz in place of file if it exists and the client takes that encoding
+void Response::_find_static_variant(const Request &req) {
+    bool accepts_br = req.accepts_encoding(Request::ENCODING_BR);
+    bool accepts_gzip = req.accepts_encoding(Request::ENCODING_GZIP);
+    if (!accepts_br && !accepts_gzip)
+        return;
+
+    std::string path = _file_handler.path();
+    if (accepts_br && _open_variant(path + ".br")) {
+        _content_encoding = "br";
+    } else if (accepts_gzip && _open_variant(path + ".gz")) {
+        _content_encoding = "gzip";
+    } else if (!_file_handler.init(path)) {
+        throw HTTP_NOT_FOUND;
+    }
+}
+
+bool Response::_open_variant(const std::string &path) {
+    try {
+        return _file_handler.init(path);
+    } catch (...) {
+        return false;
+    }
+}
+
+// Compression is up to the location, the client, the length if it is known and the type
+bool Response::_is_gzip_allowed(const Request &req, const std::string &content_type,
+                                size_t len) const {
+    const config::Location *location = req.location();
+    if (!location || !location->gzip || !req.accepts_encoding(Request::ENCODING_GZIP))
+        return false;
+    if (len < location->gzip_min_length)
+        return false;
+
+    std::string type = content_type.substr(0, content_type.find(';'));
+    type.erase(0, type.find_first_not_of(" \t"));
+    type.erase(type.find_last_not_of(" \t") + 1);
+    std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+    if (type == "text/html")
+        return true;
+    for (size_t i = 0; i < location->v_gzip_type.size(); i++) {
+        if (location->v_gzip_type[i] == "*" || strcasecmp(location->v_gzip_type[i].c_str(),
+                                                          type.c_str()) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Generated bodies are compressed in one go before their header is built
+bool Response::_gzip_body(const Request &req, const std::string &content_type) {
+    if (_body.empty() || !_is_gzip_allowed(req, content_type, _body.size()))
+        return false;
+
+    core::ByteBuffer compressed(_body.size() / 2);
+    _gzip_encoder.init(req.location()->gzip_comp_level);
+    _gzip_encoder.compress(&_body[0], _body.size(), true, compressed);
+    _body.assign(compressed.begin(), compressed.end());
+    return true;
+}
+
+// Value of a header field in the header block a CGI wrote, matched without regard to case
+static bool find_cgi_header(const core::ByteBuffer &block, size_t start, size_t end,
+                            const char *name, std::string &value) {
+    size_t name_len = strlen(name);
+    while (start < end) {
+        size_t line_end = start;
+        while (line_end < end && block[line_end] != '\n')
+            line_end++;
+        if (line_end - start > name_len && block[start + name_len] == ':' &&
+            strncasecmp(reinterpret_cast<const char *>(&block[start]), name, name_len) == 0) {
+            value.assign(block.begin() + start + name_len + 1, block.begin() + line_end);
+            value.erase(0, value.find_first_not_of(" \t"));
+            value.erase(value.find_last_not_of(" \t\r") + 1);
+            return true;
+        }
+        start = line_end + 1;
+    }
+    return false;
+}
+
+// Decides with the header block of the CGI whether its body is compressed on the way out, the
+// response header then gets the Content-Encoding in front of the CGI header lines
+bool Response::init_gzip_cgi(const Request &req, size_t cgi_header_len, bool is_cgi_done) {
+    size_t      start = _body.pos();
+    size_t      end = start + cgi_header_len;
+    size_t      len = SIZE_MAX;
+    std::string content_type = "text/html";
+    std::string value;
+
+    if (find_cgi_header(_body, start, end, "Content-Encoding", value))
+        return false;
+    find_cgi_header(_body, start, end, "Content-Type", content_type);
+    if (is_cgi_done)
+        len = _body.size() - end;
+    else if (find_cgi_header(_body, start, end, "Content-Length", value))
+        utils::str_to_num_dec(value, len);
+    if (!_is_gzip_allowed(req, content_type, len))
+        return false;
+
+    _gzip_encoder.init(req.location()->gzip_comp_level);
+    _header.append("Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n");
+    return true;
+}
+
+core::GzipEncoder &Response::gzip_encoder() { return _gzip_encoder; }
+
+// If-None-Match takes precedence over If-Modified-Since, a client sending both knows the ETag
+bool Response::_is_not_modified(const Request &req) const {
+    std::map<std::string, std::string>::const_iterator it = req.m_header().find("IF-NONE-MATCH");
+    if (it != req.m_header().end())
+        return _etag_matches(it->second);
+
+    time_t since;
+    it = req.m_header().find("IF-MODIFIED-SINCE");
+    return it != req.m_header().end() && utils::parse_http_date(it->second, since) &&
+           _file_handler.mtime() <= since;
+}
+
+// Weak comparison against a list of entity tags as If-None-Match asks for
+bool Response::_etag_matches(const std::string &value) const {
+    size_t start = 0;
+    while (start < value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos)
+            end = value.size();
+        std::string tag = value.substr(start, end - start);
+        tag.erase(0, tag.find_first_not_of(" \t"));
+        tag.erase(tag.find_last_not_of(" \t") + 1);
+        if (tag.compare(0, 2, "W/") == 0)
+            tag.erase(0, 2);
+        if (tag == "*" || tag == _etag)
+            return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+// Resolves the requested byte ranges against the file. The status tells whether the whole file,
+// some parts of it or nothing of it is sent.
+int Response::_find_ranges(const Request &req) {
+    const range_list_t &v_request_range = req.v_range();
+    size_t              size = _file_handler.max_size();
+    size_t              total_len = 0;
+
+    if (v_request_range.empty() || req.method() != Request::GET)
+        return HTTP_OK;
+    // Ranges of a copy the client has are only useful while the file is still the same, the
+    // validator is an ETag or the Last-Modified date and both have to match exactly
+    std::map<std::string, std::string>::const_iterator it = req.m_header().find("IF-RANGE");
+    if (it != req.m_header().end() && it->second != _etag &&
+        it->second != utils::http_date(_file_handler.mtime()))
+        return HTTP_OK;
+
+    for (size_t i = 0; i < v_request_range.size(); i++) {
+        Request::ByteRange range = v_request_range[i];
+        if (range.first == Request::RANGE_NONE) {
+            if (range.last == 0)
+                continue;
+            range.first = range.last < size ? size - range.last : 0;
+            range.last = size - 1;
+        } else if (range.first >= size) {
+            continue;
+        } else if (range.last >= size) {
+            range.last = size - 1;
+        }
+        // Overlapping ranges would let a short request make us send the file many times over
+        total_len += range.last - range.first + 1;
+        if (total_len > size) {
+            _v_range.clear();
+            return HTTP_OK;
+        }
+        _v_range.push_back(range);
+    }
+    if (_v_range.empty())
+        return HTTP_RANGE_NOT_SATISFIABLE;
+    if (_v_range.size() > 1)
+        _boundary = "webserv_boundary_" + utils::num_to_str_dec(++_num_multipart);
+    return HTTP_PARTIAL_CONTENT;
+}
+
+std::string Response::_content_range(const Request::ByteRange &range) const {
+    return "bytes " + utils::num_to_str_dec(range.first) + "-" +
+           utils::num_to_str_dec(range.last) + "/" +
+           utils::num_to_str_dec(_file_handler.max_size());
+}
+
+std::string Response::_range_part_head(const Request::ByteRange &range) const {
+    return "\r\n--" + _boundary + "\r\nContent-Type: " + _content_type +
+           "\r\nContent-Range: " + _content_range(range) + "\r\n\r\n";
+}
+
+size_t Response::_multipart_len() const {
+    size_t len = _boundary.size() + 8;  // \r\n--boundary--\r\n
+    for (size_t i = 0; i < _v_range.size(); i++)
+        len += _range_part_head(_v_range[i]).size() + _v_range[i].last - _v_range[i].first + 1;
+    return len;
+}
+
+// Moves on to the next range of a multipart/byteranges response and leaves its part header in
+// body(), the closing boundary comes last. False once nothing is left, the file is closed then.
+bool Response::next_range_part() {
+    _body.clear();
+    _body.set_pos(0);
+    if (_boundary.empty() || _range_idx > _v_range.size()) {
+        _file_handler.close();
+        return false;
+    }
+    if (_range_idx == _v_range.size()) {
+        _body.append(("\r\n--" + _boundary + "--\r\n").c_str());
+    } else {
+        const Request::ByteRange &range = _v_range[_range_idx];
+        _body.append(_range_part_head(range).c_str());
+        _file_handler.set_range(range.first, range.last - range.first + 1);
+    }
+    _range_idx++;
+    return true;
+}
+
+// Small files are answered with complete responses kept in memory, the open file tells whether
+// the cached one is outdated. An Expires date relative to now would go stale in the cache.
+bool Response::_is_cacheable(const Request &req, size_t size) const {
+    return _response_cache && _response_cache->is_enabled() && req.location()->response_cache &&
+           req.location()->expires != config::Location::EXPIRES_TIME &&
+           size <= RESPONSE_CACHE_MAX_FILE_SIZE;
+}
+
+// The requested file and the encoding it is sent with, not the variant served for it: a direct
+// request of file.gz gets other headers than file sent with Content-Encoding gzip. The headers
+// also depend on the location that maps the file.
+std::string Response::_cache_key(const Request &req, const std::string &path) const {
+    std::string key = path + "\n" + (_content_encoding ? _content_encoding : "identity");
+    key += "\n" + utils::num_to_str_hex(reinterpret_cast<size_t>(req.location()));
+    if (req.connection_should_close())
+        return key + "\nclose";
+    return key + "\nkeep-alive";
+}
+
+void Response::_cache_response(const std::string &key) {
+    time_t           mtime = _file_handler.mtime();
+    size_t           size = _file_handler.max_size();
+    core::ByteBuffer response(_header.size() + size);
+
+    response.insert(response.end(), _header.begin(), _header.end());
+    while (_file_handler.left_size() > 0) {
+        size_t read_len = _file_handler.read(core::FileHandler::BUF_SIZE);
+        response.insert(response.end(), _file_handler.buf(), _file_handler.buf() + read_len);
+    }
+    _prebuilt = core::SharedBuffer(response);
+    _response_cache->insert(key, mtime, size, _prebuilt);
+    _header.clear();
+    _body_type = BODY_CACHED;
+}
+
 static std::map<int, error_page_t> new_error_page_default() {
     std::map<int, error_page_t> m_error_page;
 
@@ -66,8 +417,14 @@ const std::map<int, error_page_t> Response::_m_error_page = new_error_page_defau
 Response::Response()
     : _body_type(BODY_NONE),
       _state(HEADER),
+      _response_cache(NULL),
+      _listing_cache(NULL),
+      _content_type(NULL),
+      _content_encoding(NULL),
+      _range_idx(0),
+      _num_multipart(0),
       _cgi_pass(NULL),
-      _is_dir_listing(false),
+      _is_upload(false),
       _index_file(NULL) {
     _header.reserve(MAX_INFO_LEN);
 }
@@ -82,10 +439,20 @@ core::ByteBuffer &Response::header() { return _header; }
 
 core::ByteBuffer &Response::body() { return _body; }
 
+core::SharedBuffer &Response::prebuilt() { return _prebuilt; }
+
 void Response::set_state(Response::State new_state) { _state = new_state; }
 
 core::FileHandler &Response::file_handler() { return _file_handler; }
 
+void Response::set_response_cache(core::ResponseCache *response_cache) {
+    _response_cache = response_cache;
+}
+
+void Response::set_listing_cache(core::ResponseCache *listing_cache) {
+    _listing_cache = listing_cache;
+}
+
 void Response::init() {
     _body_type = BODY_NONE;
     _state = HEADER;
@@ -93,8 +460,17 @@ void Response::init() {
     _header.set_pos(0);
     _body.clear();
     _body.set_pos(0);
+    _prebuilt.reset();
+    _content_type = NULL;
+    _content_encoding = NULL;
+    _etag.clear();
+    _gzip_encoder.end();
+    _v_range.clear();
+    _range_idx = 0;
+    _boundary.clear();
     _cgi_pass = NULL;
-    _is_dir_listing = false;
+    _dir_lister.close();
+    _is_upload = false;
     _index_file = NULL;
 }
 
@@ -117,9 +493,10 @@ const config::Redirect *Response::_find_redir(const config::Location *location,
 bool Response::_find_index(const config::Location *location, const std::string &absolute_path) {
     for (size_t i = 0; i < location->v_index.size(); i++) {
         try {
-            _file_handler.init(absolute_path + "/" + location->v_index[i]);
-            _index_file = &location->v_index[i];
-            return true;
+            if (_file_handler.init(absolute_path + "/" + location->v_index[i])) {
+                _index_file = &location->v_index[i];
+                return true;
+            }
         } catch (...) {
         }
     }
@@ -190,7 +567,110 @@ void Response::_build_redir(const Request &req, const config::Redirect &redir) {
     _header.append("\r\n\r\n");
 }
 
+// The path is checked for ".." segments again, the request line only keeps it inside the root of
+// the server while a file outside the location must not be removed either
+void Response::_build_delete(const Request &req) {
+    const std::string &path = req.relative_path();
+    for (size_t pos = path.find(".."); pos != std::string::npos; pos = path.find("..", pos + 2)) {
+        if ((pos == 0 || path[pos - 1] == '/') && (pos + 2 == path.size() || path[pos + 2] == '/'))
+            throw HTTP_FORBIDDEN;
+    }
+    if (unlink(req.absolute_path().c_str()) == -1) {
+        int         error = errno;
+        struct stat file_stat;
+        // Directories are not removed, macOS reports them as EPERM
+        if (error == EISDIR || (error == EPERM && stat(req.absolute_path().c_str(), &file_stat) == 0 &&
+                                S_ISDIR(file_stat.st_mode)))
+            throw HTTP_CONFLICT;
+        if (error == ENOENT || error == ENOTDIR || error == ENAMETOOLONG)
+            throw HTTP_NOT_FOUND;
+        if (error == EACCES || error == EPERM || error == EROFS)
+            throw HTTP_FORBIDDEN;
+        throw HTTP_INTERNAL_SERVER_ERROR;
+    }
+    _body_type = BODY_NONE;
+    _header.append("HTTP/1.1 ");
+    _header.append(g_m_status_codes.find(HTTP_NO_CONTENT)->second.c_str());
+    _header.append("\r\nServer: ");
+    _header.append(SERVER_NAME);
+    _header.append("\r\nConnection: ");
+    if (req.connection_should_close())
+        _header.append("close");
+    else
+        _header.append("keep-alive");
+    _header.append("\r\n\r\n");
+}
+
+// Small listings get a Content-Length and are cached until the directory changes, longer ones are
+// sent chunked while the directory is read. Listings have a cache of their own, so they are kept
+// without response_cache_entries.
+void Response::_build_dir_listing(const Request &req) {
+    if (req.method() != Request::GET && req.method() != Request::HEAD)
+        throw HTTP_METHOD_NOT_ALLOWED;
+    _dir_lister.open(req.absolute_path());
+
+    // A change within the second the listing was rendered in would not show in the mtime
+    std::string key = _cache_key(req, req.absolute_path());
+    bool        is_cacheable = req.method() == Request::GET && _dir_lister.mtime() < time(NULL) &&
+                               _listing_cache && req.location()->response_cache;
+    if (is_cacheable &&
+        _listing_cache->find(key, _dir_lister.mtime(), _dir_lister.size(), _prebuilt)) {
+        _dir_lister.close();
+        _body_type = BODY_CACHED;
+        return;
+    }
+
+    _dir_lister.render_head(req.path_decoded(), _body);
+    bool is_done = _dir_lister.render(_body, DIR_LISTING_BUF_SIZE);
+    _header.append("HTTP/1.1 ");
+    _header.append(g_m_status_codes.find(HTTP_OK)->second.c_str());
+    _header.append("\r\nServer: ");
+    _header.append(SERVER_NAME);
+    _header.append("\r\nContent-Type: text/html");
+    if (is_done) {
+        _header.append("\r\nContent-Length: ");
+        _header.append(utils::num_to_str_dec(_body.size()).c_str());
+    } else {
+        _header.append("\r\nTransfer-Encoding: chunked");
+    }
+    _header.append("\r\nConnection: ");
+    if (req.connection_should_close())
+        _header.append("close");
+    else
+        _header.append("keep-alive");
+    _header.append("\r\n\r\n");
+
+    if (req.method() == Request::HEAD) {
+        _dir_lister.close();
+        _body.clear();
+        _body_type = BODY_NONE;
+        return;
+    }
+    _body_type = is_done ? BODY_BUFFER : BODY_LISTING;
+    if (is_done && is_cacheable) {
+        core::ByteBuffer response(_header.size() + _body.size());
+        response.insert(response.end(), _header.begin(), _header.end());
+        response.insert(response.end(), _body.begin(), _body.end());
+        _prebuilt = core::SharedBuffer(response);
+        _listing_cache->insert(key, _dir_lister.mtime(), _dir_lister.size(), _prebuilt);
+        _header.clear();
+        _body.clear();
+        _body_type = BODY_CACHED;
+    }
+}
+
 void Response::build(const Request &req) {
+    // The body is stored by the connection, build_upload answers once it is complete
+    if (!req.location()->upload_store.empty() &&
+        (req.method() == Request::POST || req.method() == Request::PUT)) {
+        _is_upload = true;
+        return;
+    }
+    if (req.method() == Request::DELETE && req.location()->delete_files) {
+        _build_delete(req);
+        return;
+    }
+
     bool directory;
     if (req.path_decoded()[req.path_decoded().size() - 1] == '/')
         directory = true;
@@ -210,10 +690,7 @@ void Response::build(const Request &req) {
 
     if (directory && !_find_index(req.location(), req.absolute_path())) {
         if (req.location()->directory_listing) {
-            _body_type = BODY_CGI;
-            _construct_header_cgi(req);
-            _is_dir_listing = true;
-            _cgi_script_relative_path = req.relative_path();
+            _build_dir_listing(req);
             return;
         }
         throw HTTP_NOT_FOUND;
@@ -236,12 +713,43 @@ void Response::build(const Request &req) {
         throw HTTP_METHOD_NOT_ALLOWED;
     }
 
+    std::string path = _file_handler.path();
+    _content_type = mime_type(path);
+    if (req.location()->gzip_static)
+        _find_static_variant(req);
+
+    _etag = "\"" + utils::num_to_str_hex(_file_handler.ino()) + "-" +
+            utils::num_to_str_hex(_file_handler.mtime()) + "-" +
+            utils::num_to_str_hex(_file_handler.max_size()) + "\"";
+    if (_is_not_modified(req)) {
+        _body_type = BODY_NONE;
+        _construct_header_not_modified(req);
+        return;
+    }
+
+    bool is_cacheable = false;
+    int  status_code = HTTP_OK;
     if (req.method() == Request::HEAD || _file_handler.max_size() == 0) {
         _body_type = Response::BODY_NONE;
     } else {
         _body_type = Response::BODY_FILE;
+        status_code = _find_ranges(req);
+        if (status_code == HTTP_RANGE_NOT_SATISFIABLE) {
+            build_error(req, status_code);
+            _file_handler.close();
+            return;
+        }
+        is_cacheable = status_code == HTTP_OK && _is_cacheable(req, _file_handler.max_size());
+        if (is_cacheable && _response_cache->find(_cache_key(req, path), _file_handler.mtime(),
+                                                  _file_handler.max_size(), _prebuilt)) {
+            _file_handler.close();
+            _body_type = BODY_CACHED;
+            return;
+        }
     }
-    _construct_header_file(req);
+    _construct_header_file(req, status_code);
+    if (is_cacheable)
+        _cache_response(_cache_key(req, path));
 }
 
 void Response::build_error(const Request &req, int error_code) {
@@ -258,21 +766,76 @@ void Response::build_error(const Request &req, int error_code) {
         error_page = &it->second;
     }
     _body.assign(error_page->content.begin(), error_page->content.end());
+    bool is_gzip = _gzip_body(req, error_page->content_type);
     _header.append("HTTP/1.1 ");
     _header.append(g_m_status_codes.find(error_code)->second.c_str());
     _header.append("\r\nServer: ");
     _header.append(SERVER_NAME);
     _header.append("\r\nContent-Type: ");
     _header.append(error_page->content_type.c_str());
+    if (is_gzip)
+        _header.append("\r\nContent-Encoding: gzip\r\nVary: Accept-Encoding");
+    if (error_code == HTTP_RANGE_NOT_SATISFIABLE) {
+        _header.append("\r\nContent-Range: bytes */");
+        _header.append(utils::num_to_str_dec(_file_handler.max_size()).c_str());
+    }
     _header.append("\r\nContent-Length: ");
     _header.append(utils::num_to_str_dec(_body.size()).c_str());
-    if (error_code == HTTP_NOT_FOUND || error_code == HTTP_FORBIDDEN)
+    if (error_code == HTTP_RANGE_NOT_SATISFIABLE && !req.connection_should_close())
+        _header.append("\r\nConnection: keep-alive\r\n\r\n");
+    else if (error_code == HTTP_NOT_FOUND || error_code == HTTP_FORBIDDEN)
         _header.append("\r\nConnection: keep-alive\r\n\r\n");
     else
         _header.append("\r\nConnection: close\r\n\r\n");
 }
 
-bool Response::is_dir_listing() const { return _is_dir_listing; }
+void Response::build_upload(const Request &req, int status_code,
+                            const std::vector<std::string> &v_stored) {
+    const std::string &status_code_msg = g_m_status_codes.find(status_code)->second;
+    if (status_code == HTTP_NO_CONTENT) {
+        _body_type = BODY_NONE;
+    } else {
+        _body_type = BODY_BUFFER;
+        _body.append("<html>\r\n<head><title>");
+        _body.append(status_code_msg.c_str());
+        _body.append("</title></head>\r\n<body>\r\n");
+        if (v_stored.empty())
+            _body.append("<p>No file was uploaded</p>\r\n");
+        for (size_t i = 0; i < v_stored.size(); i++) {
+            _body.append("<p>The file \"");
+            _body.append(utils::html_escape(v_stored[i]).c_str());
+            _body.append("\" was uploaded successfully</p>\r\n");
+        }
+        _body.append("<hr><center>webserv</center>\r\n</body>\r\n</html>\r\n");
+    }
+    _header.append("HTTP/1.1 ");
+    _header.append(status_code_msg.c_str());
+    _header.append("\r\nServer: ");
+    _header.append(SERVER_NAME);
+    if (_body_type == BODY_BUFFER) {
+        _header.append("\r\nContent-Type: text/html");
+        _header.append("\r\nContent-Length: ");
+        _header.append(utils::num_to_str_dec(_body.size()).c_str());
+    }
+    _header.append("\r\nConnection: ");
+    if (req.connection_should_close())
+        _header.append("close");
+    else
+        _header.append("keep-alive");
+    _header.append("\r\n\r\n");
+}
+
+// Next part of a chunked listing, false once the whole page was handed out
+bool Response::render_listing() {
+    _body.clear();
+    _body.set_pos(0);
+    if (!_dir_lister.is_open())
+        return false;
+    _dir_lister.render(_body, DIR_LISTING_BUF_SIZE);
+    return true;
+}
+
+bool Response::is_upload() const { return _is_upload; }
 
 bool Response::need_cgi() const { return _body_type == BODY_CGI; }
 
@@ -308,6 +871,12 @@ void Response::print() const {
         case BODY_CGI:
             std::cout << "CGI\n";
             break;
+        case BODY_CACHED:
+            std::cout << "CACHED\n";
+            break;
+        case BODY_LISTING:
+            std::cout << "LISTING\n";
+            break;
     }
     if (_cgi_pass)
         std::cout << utils::COLOR_CY_1 << " CGI_PASS:  " << utils::COLOR_NO << _cgi_pass->path
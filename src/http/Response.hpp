@@ -1,9 +1,15 @@
 #pragma once
 
 #include <map>
+#include <string>
+#include <vector>
 
 #include "../core/ByteBuffer.hpp"
+#include "../core/DirLister.hpp"
 #include "../core/FileHandler.hpp"
+#include "../core/GzipEncoder.hpp"
+#include "../core/ResponseCache.hpp"
+#include "../core/SharedBuffer.hpp"
 #include "Request.hpp"
 #include "error_page.hpp"
 
@@ -11,24 +17,55 @@ namespace http {
 
 class Response {
    public:
-    enum BodyType { BODY_NONE, BODY_CGI, BODY_FILE, BODY_BUFFER };
+    enum BodyType { BODY_NONE, BODY_CGI, BODY_FILE, BODY_BUFFER, BODY_CACHED, BODY_LISTING };
     enum State { HEADER, HEADER_CGI, BODY, DONE };
 
    private:
+    typedef std::vector<Request::ByteRange> range_list_t;
+
     core::FileHandler      _file_handler;
     BodyType               _body_type;
     State                  _state;
     core::ByteBuffer       _header;
     core::ByteBuffer       _body;
+    core::ResponseCache   *_response_cache;
+    core::ResponseCache   *_listing_cache;  // independent of response_cache_entries
+    core::SharedBuffer     _prebuilt;
+    const char            *_content_type;
+    const char            *_content_encoding;
+    std::string            _etag;
+    core::GzipEncoder      _gzip_encoder;
+    range_list_t           _v_range;
+    size_t                 _range_idx;
+    std::string            _boundary;
+    size_t                 _num_multipart;
     const config::CgiPass *_cgi_pass;
     std::string            _cgi_script_relative_path;
-    bool                   _is_dir_listing;
+    core::DirLister        _dir_lister;
+    bool                   _is_upload;
     const std::string     *_index_file;
 
     static const std::map<int, error_page_t> _m_error_page;
 
-    void _construct_header_file(const Request &req);
+    void _construct_header_file(const Request &req, int status_code);
     void _construct_header_cgi(const Request &req);
+    void _construct_header_not_modified(const Request &req);
+    void _append_cache_header(const Request &req);
+    void _find_static_variant(const Request &req);
+    bool _open_variant(const std::string &path);
+    bool _is_gzip_allowed(const Request &req, const std::string &content_type, size_t len) const;
+    bool _gzip_body(const Request &req, const std::string &content_type);
+
+    bool        _is_not_modified(const Request &req) const;
+    bool        _etag_matches(const std::string &value) const;
+    int         _find_ranges(const Request &req);
+    std::string _content_range(const Request::ByteRange &range) const;
+    std::string _range_part_head(const Request::ByteRange &range) const;
+    size_t      _multipart_len() const;
+
+    bool        _is_cacheable(const Request &req, size_t size) const;
+    std::string _cache_key(const Request &req, const std::string &path) const;
+    void        _cache_response(const std::string &key);
 
     const config::Redirect *_find_redir(const config::Location *location,
                                         const std::string &relative_path, bool dir);
@@ -37,6 +74,8 @@ class Response {
                                           const std::string      &path);
     void                   _build_redir_dir(const Request &req);
     void                   _build_redir(const Request &req, const config::Redirect &redir);
+    void                   _build_delete(const Request &req);
+    void                   _build_dir_listing(const Request &req);
 
    public:
     Response();
@@ -46,16 +85,25 @@ class Response {
     BodyType          body_type() const;
     core::ByteBuffer &header();
     core::ByteBuffer &body();
+    core::SharedBuffer &prebuilt();
 
     void               set_state(State new_state);
     core::FileHandler &file_handler();
+    void               set_response_cache(core::ResponseCache *response_cache);
+    void               set_listing_cache(core::ResponseCache *listing_cache);
 
     void init();
 
     void build(const Request &req);
     void build_error(const Request &req, int error_code);
+    void build_upload(const Request &req, int status_code, const std::vector<std::string> &v_stored);
+    bool init_gzip_cgi(const Request &req, size_t cgi_header_len, bool is_cgi_done);
+    bool next_range_part();
+    bool render_listing();
+
+    core::GzipEncoder &gzip_encoder();
 
-    bool                   is_dir_listing() const;
+    bool                   is_upload() const;
     bool                   need_cgi() const;
     const config::CgiPass *cgi_pass() const;
     const std::string     &cgi_script_relative_path() const;
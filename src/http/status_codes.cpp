@@ -12,18 +12,27 @@ struct s_status_code {
 
 static const struct s_status_code static_status_codes[] = {
     {HTTP_OK, HTTP_OK_MSG},
+    {HTTP_CREATED, HTTP_CREATED_MSG},
+    {HTTP_NO_CONTENT, HTTP_NO_CONTENT_MSG},
+    {HTTP_PARTIAL_CONTENT, HTTP_PARTIAL_CONTENT_MSG},
     {HTTP_MOVED_PERMANENTLY, HTTP_MOVED_PERMANENTLY_MSG},
     {HTTP_FOUND, HTTP_FOUND_MSG},
     {HTTP_TEMPORARY_REDIRECT, HTTP_TEMPORARY_REDIRECT_MSG},
     {HTTP_PERMANENT_REDIRECT, HTTP_PERMANENT_REDIRECT_MSG},
+    {HTTP_NOT_MODIFIED, HTTP_NOT_MODIFIED_MSG},
     {HTTP_BAD_REQUEST, HTTP_BAD_REQUEST_MSG},
     {HTTP_FORBIDDEN, HTTP_FORBIDDEN_MSG},
     {HTTP_NOT_FOUND, HTTP_NOT_FOUND_MSG},
     {HTTP_METHOD_NOT_ALLOWED, HTTP_METHOD_NOT_ALLOWED_MSG},
+    {HTTP_CONFLICT, HTTP_CONFLICT_MSG},
     {HTTP_CONTENT_TOO_LARGE, HTTP_CONTENT_TOO_LARGE_MSG},
+    {HTTP_UNSUPPORTED_MEDIA_TYPE, HTTP_UNSUPPORTED_MEDIA_TYPE_MSG},
+    {HTTP_RANGE_NOT_SATISFIABLE, HTTP_RANGE_NOT_SATISFIABLE_MSG},
     {HTTP_INTERNAL_SERVER_ERROR, HTTP_INTERNAL_SERVER_ERROR_MSG},
     {HTTP_NOT_IMPLEMENTED, HTTP_NOT_IMPLEMENTED_MSG},
-    {HTTP_VERSION_NOT_SUPPORTED, HTTP_VERSION_NOT_SUPPORTED_MSG}};
+    {HTTP_BAD_GATEWAY, HTTP_BAD_GATEWAY_MSG},
+    {HTTP_VERSION_NOT_SUPPORTED, HTTP_VERSION_NOT_SUPPORTED_MSG},
+    {HTTP_INSUFFICIENT_STORAGE, HTTP_INSUFFICIENT_STORAGE_MSG}};
 
 std::map<int, std::string> new_m_status_codes() {
     std::map<int, std::string> m_implemented;
@@ -1,7 +1,9 @@
+#include <csignal>
+#include <cstdlib>
 #include <string>
 
 #include "config/Parser.hpp"
-#include "core/Webserver.hpp"
+#include "core/Master.hpp"
 #include "http/status_codes.hpp"
 #include "settings.hpp"
 #include "utils/color.hpp"
@@ -17,20 +19,28 @@ int main(int argc, char** argv) {
         std::cerr << "Error\nusage: " << argv[0] << " [config_file]\n";
         return EXIT_FAILURE;
     }
+    // Writes to closed sockets and pipes are handled as errors instead of killing the server
+    signal(SIGPIPE, SIG_IGN);
     try {
         std::vector<config::Server> v_server;
+        config::Global              global;
 
         config::Parser parser;
         const char*    config_file = argc == 2 ? argv[1] : DEFAULT_CONFIG_FILE;
-        parser.parse(config_file, v_server);
+        parser.parse(config_file, v_server, global);
 
 #if PRINT_LEVEL > 0
         std::cout << utils::COLOR_CY_1 << "Parsed config: " << utils::COLOR_NO << config_file
                   << std::endl;
 #endif
 
-        core::Webserver webserver(v_server);
-        webserver.run();
+        // Forked before the event loops allocate anything, so it stays small
+        core::CgiSpawner cgi_spawner;
+        if (global.cgi_spawner)
+            cgi_spawner.start();
+
+        core::Master master(global, v_server, cgi_spawner);
+        master.run();
     } catch (const std::exception& e) {
         std::cerr << "[";
         utils::print_timestamp(std::cerr);
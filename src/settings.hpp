@@ -3,22 +3,60 @@
 #define PRINT_LEVEL 1
 
 #define MAX_CONNECTIONS 1024
+#define MAX_POLLED_EVENTS 512
+#define MULTI_ACCEPT 64  // connections accepted per listen socket event
 #define CONN_TIMEOUT_TIME 60000
 
+#define TIMER_TICK_TIME 10
+#define TIMER_WHEEL_SIZE 1024
+
+#define WORKERS_AUTO 0  // one worker per online CPU
+#define MAX_WORKERS 256
+#define RESPAWN_MIN_DELAY 100     // ms before a worker that died young is respawned, doubled per death
+#define RESPAWN_MAX_DELAY 10000
+#define RESPAWN_RESET_TIME 10000  // ms a worker has to live before its delay starts over
+
+#define MAX_OPEN_FILE_CACHE 65536
+#define OPEN_FILE_CACHE_VALID 60  // seconds before a cached file is checked again
+#define MAX_OPEN_FILE_CACHE_VALID 86400
+
+#define MAX_RESPONSE_CACHE_ENTRIES 65536
+#define RESPONSE_CACHE_SIZE (1ULL << 23)           // 8MB
+#define RESPONSE_CACHE_MAX_FILE_SIZE (1ULL << 16)  // 64KB
+#define LISTING_CACHE_ENTRIES 64         // rendered directory listings kept per event loop
+#define LISTING_CACHE_SIZE (1ULL << 22)  // 4MB
+
 #define MAX_INFO_LEN 8196
 
+#define MAX_RANGES 16  // requests with more byte ranges get the whole file
+
+#define EXPIRES_MAX_TIME 315360000  // 10 years, what "expires max" announces
+
 #define MAX_PIPE_SIZE 1048576
 
+#define GZIP_BUF_SIZE 16384
+#define GZIP_MEM_LEVEL 8
+#define GZIP_COMP_LEVEL 1
+#define GZIP_MIN_LENGTH 20
+
 #define FILE_BUF_SIZE 4096
 #define CGI_BUF_SIZE 4096
+#define CGI_BODY_BUF_SIZE 65536  // request body held for a CGI before the socket is not read
+#define CGI_OUTPUT_BUF_SIZE 262144  // unsent CGI output per connection before the CGI is not read
+#define CGI_SPAWN_MSG_SIZE 65536  // program, directory and environment of a CGI for the spawner
+#define MAX_CGI_POOL_WORKERS 256
+#define CGI_POOL_MAX_REQUESTS 1000  // requests a pooled CGI worker serves before it is replaced
+#define CGI_POOL_LOG_TIME 10000     // ms between utilization reports of the CGI pools
+#define FASTCGI_KEEPALIVE 16     // idle FastCGI connections kept per event loop
+#define MAX_FASTCGI_KEEPALIVE 1024
 #define CONNECTION_BUF_SIZE 4096
 
 #define CLIENT_MAX_BODY_SIZE (1ULL << 26)  // 64MB
+#define CLIENT_BODY_TEMP_PATH "/tmp"
 
 #define DEFAULT_CONFIG_FILE "./webserv.conf"
 
 #define SERVER_NAME "webserv"
 
-#define DIR_LISTING_CGI_PATH "/usr/bin/python3"
-#define DIR_LISTING_CGI_SCRIPT_PATH "./data/cgi/directory_listing.py"
+#define DIR_LISTING_BUF_SIZE 65536  // longer listings are sent chunked while they are read
 
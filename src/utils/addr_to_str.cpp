@@ -11,9 +11,11 @@ namespace utils {
 
 std::string addr_to_str(const core::Address& addr) {
     struct in_addr in_addr;
+    char           addr_str[INET_ADDRSTRLEN];
     in_addr.s_addr = addr.addr;
     std::string str;
-    str += inet_ntoa(in_addr);
+    if (inet_ntop(AF_INET, &in_addr, addr_str, sizeof(addr_str)))
+        str += addr_str;
     str += ":";
     str += num_to_str_dec(addr.port);
     return str;
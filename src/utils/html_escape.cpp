@@ -0,0 +1,33 @@
+#include "html_escape.hpp"
+
+namespace utils {
+
+std::string html_escape(const std::string &str) {
+    std::string escaped;
+
+    escaped.reserve(str.size());
+    for (size_t i = 0; i < str.size(); i++) {
+        switch (str[i]) {
+            case '&':
+                escaped += "&amp;";
+                break;
+            case '<':
+                escaped += "&lt;";
+                break;
+            case '>':
+                escaped += "&gt;";
+                break;
+            case '"':
+                escaped += "&quot;";
+                break;
+            case '\'':
+                escaped += "&#39;";
+                break;
+            default:
+                escaped += str[i];
+        }
+    }
+    return escaped;
+}
+
+}  // namespace utils
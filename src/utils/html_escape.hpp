@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+namespace utils {
+
+std::string html_escape(const std::string &str);
+
+}  // namespace utils
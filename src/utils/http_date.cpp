@@ -0,0 +1,42 @@
+#include "http_date.hpp"
+
+#include <cstring>
+#include <ctime>
+#include <string>
+
+namespace utils {
+
+// IMF-fixdate as used in HTTP headers, e.g. "Sun, 06 Nov 1994 08:49:37 GMT". Day and month
+// names are filled in by hand, strftime would spell them in the current locale.
+std::string http_date(time_t t) {
+    static const char *days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    struct tm          time_buf;
+    char               buf[32];
+
+    gmtime_r(&t, &time_buf);
+    size_t len = strftime(buf, sizeof(buf), "XXX, %d XXX %Y %H:%M:%S GMT", &time_buf);
+    std::string date(buf, len);
+    date.replace(0, 3, days[time_buf.tm_wday]);
+    date.replace(8, 3, months[time_buf.tm_mon]);
+    return date;
+}
+
+// Accepts the IMF-fixdate and the two obsolete formats recipients still have to understand
+bool parse_http_date(const std::string &str, time_t &t) {
+    static const char *formats[] = {"%a, %d %b %Y %H:%M:%S GMT", "%A, %d-%b-%y %H:%M:%S GMT",
+                                    "%a %b %e %H:%M:%S %Y"};
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        struct tm time_buf;
+        memset(&time_buf, 0, sizeof(time_buf));
+        const char *end = strptime(str.c_str(), formats[i], &time_buf);
+        if (end && *end == '\0') {
+            t = timegm(&time_buf);
+            return t != -1;
+        }
+    }
+    return false;
+}
+
+}  // namespace utils
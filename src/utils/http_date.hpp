@@ -0,0 +1,11 @@
+#pragma once
+
+#include <ctime>
+#include <string>
+
+namespace utils {
+
+std::string http_date(time_t t);
+bool        parse_http_date(const std::string &str, time_t &t);
+
+}  // namespace utils
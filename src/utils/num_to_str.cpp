@@ -1,5 +1,7 @@
 #include "num_to_str.hpp"
 
+#include <algorithm>
+
 namespace utils {
 
 void num_to_str_hex(size_t num, std::string &str) {
@@ -1,12 +1,14 @@
 #include "timestamp.hpp"
 
+#include <ctime>
 #include <iostream>
 
 namespace utils {
 
 void print_timestamp(std::ostream& os) {
-    std::time_t t = time(NULL);
-    struct tm*  time_master = localtime(&t);
+    time_t     t = time(NULL);
+    struct tm  time_buf;
+    struct tm* time_master = localtime_r(&t, &time_buf);
 
     os << time_master->tm_year + 1900 << "/";
     if (time_master->tm_mon + 1 < 10)
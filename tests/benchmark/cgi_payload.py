@@ -0,0 +1,12 @@
+#!/usr/bin/python3
+
+# Writes QUERY_STRING megabytes of a repeated 64KB block, cheap enough that webserv dominates
+
+import os
+
+size = int(os.environ.get("QUERY_STRING") or "1") * 1024 * 1024
+block = bytes(range(256)) * 256
+
+os.write(1, b"Content-Type: application/octet-stream\r\n\r\n")
+while size > 0:
+    size -= os.write(1, block[:size])
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+
+# Minimal FastCGI responder standing in for php-fpm. Every request is answered with its method,
+# the length and md5 of its body and how many connections the server accepted so far, which shows
+# whether webserv reuses its connections. Started with a script path instead of an address it runs
+# as a plain CGI script and prints the same, for a comparison with cgi_pass. Started by cgi_pool
+# with a socket as stdin and no environment it reads the records from stdin, the pid in the
+# answer shows when a worker was replaced.
+#
+# usage: ./fastcgi_app.py unix:/path | host:port
+#        python3 fastcgi_app.py (as CGI)
+#        ./fastcgi_app.py (as cgi_pool worker)
+
+import hashlib
+import os
+import socket
+import socketserver
+import stat
+import struct
+import sys
+
+BEGIN_REQUEST, END_REQUEST, PARAMS, STDIN, STDOUT = 1, 3, 4, 5, 6
+KEEP_CONN = 1
+
+accepted = 0
+
+
+def answer(method, body, connections):
+    return (
+        "Content-Type: text/plain\r\n\r\n"
+        "method=%s\nlength=%d\nmd5=%s\nconnections=%d\npid=%d\n"
+        % (method, len(body), hashlib.md5(body).hexdigest(), connections, os.getpid())
+    ).encode()
+
+
+def record(kind, request_id, content):
+    padding = (8 - len(content) % 8) % 8
+    header = struct.pack("!BBHHBB", 1, kind, request_id, len(content), padding, 0)
+    return header + content + b"\0" * padding
+
+
+def decode_params(data):
+    params, pos = {}, 0
+    while pos < len(data):
+        lens = []
+        for _ in range(2):
+            if data[pos] >> 7:
+                lens.append(struct.unpack("!I", data[pos : pos + 4])[0] & 0x7FFFFFFF)
+                pos += 4
+            else:
+                lens.append(data[pos])
+                pos += 1
+        name = data[pos : pos + lens[0]].decode()
+        params[name] = data[pos + lens[0] : pos + lens[0] + lens[1]].decode()
+        pos += lens[0] + lens[1]
+    return params
+
+
+def read_exact(sock, length):
+    data = b""
+    while len(data) < length:
+        chunk = sock.recv(length - len(data))
+        if not chunk:
+            raise EOFError
+        data += chunk
+    return data
+
+
+def serve(sock):
+    global accepted
+    accepted += 1
+    params, body, keep_conn = b"", b"", False
+    try:
+        while True:
+            _, kind, request_id, length, padding, _ = struct.unpack("!BBHHBB", read_exact(sock, 8))
+            content = read_exact(sock, length + padding)[:length]
+            if kind == BEGIN_REQUEST:
+                keep_conn = bool(content[2] & KEEP_CONN)
+                params, body = b"", b""
+            elif kind == PARAMS:
+                params += content
+            elif kind == STDIN and content:
+                body += content
+            elif kind == STDIN:
+                method = decode_params(params).get("REQUEST_METHOD", "")
+                out = answer(method, body, accepted)
+                sock.sendall(
+                    record(STDOUT, request_id, out)
+                    + record(STDOUT, request_id, b"")
+                    + record(END_REQUEST, request_id, b"\0" * 8)
+                )
+                if not keep_conn:
+                    return
+    except (EOFError, ConnectionError):
+        return
+
+
+class Handler(socketserver.BaseRequestHandler):
+    def handle(self):
+        serve(self.request)
+
+
+class UnixServer(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+    daemon_threads = True
+
+
+class TcpServer(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+is_cgi = "REQUEST_METHOD" in os.environ
+if len(sys.argv) < 2 and not is_cgi and stat.S_ISSOCK(os.fstat(0).st_mode):
+    serve(socket.socket(fileno=0))
+elif len(sys.argv) < 2 or is_cgi:
+    body = sys.stdin.buffer.read()
+    sys.stdout.buffer.write(answer(os.environ.get("REQUEST_METHOD", ""), body, 1))
+elif sys.argv[1].startswith("unix:"):
+    path = sys.argv[1][5:]
+    if os.path.exists(path):
+        os.unlink(path)
+    UnixServer(path, Handler).serve_forever()
+else:
+    host, port = sys.argv[1].rsplit(":", 1)
+    TcpServer((host, int(port)), Handler).serve_forever()
@@ -0,0 +1,26 @@
+#!/usr/bin/python3
+
+# Writes QUERY_STRING megabytes of access log like text, streamed in 64KB pieces
+
+import os
+import sys
+
+size = int(os.environ.get("QUERY_STRING") or "1") * 1024 * 1024
+
+sys.stdout.write("Content-Type: text/plain\r\n\r\n")
+sys.stdout.flush()
+
+line = 0
+while size > 0:
+    lines = []
+    piece = 0
+    while piece < 65536 and piece < size:
+        text = '127.0.0.%d - - "GET /assets/%d.js HTTP/1.1" %d %d "Mozilla/5.0"\n' % (
+            line % 256, line % 1000, 200 if line % 7 else 404, (line * 7919) % 100000)
+        lines.append(text)
+        piece += len(text)
+        line += 1
+    out = "".join(lines)[:size]
+    sys.stdout.write(out)
+    sys.stdout.flush()
+    size -= len(out)
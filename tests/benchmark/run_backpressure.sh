@@ -0,0 +1,109 @@
+#!/usr/bin/env bash
+
+# Streams a large CGI response to clients that read slower than the CGI writes and records how
+# much the peak RSS of webserv grows meanwhile. The output is forwarded through user space
+# (cgi_splice off), so without backpressure the growth follows the size of the response, with it
+# the output buffer per connection. The peak RSS is read from /proc, so this runs on Linux only.
+# The quarantine of AddressSanitizer is turned off, it would hold on to every freed chunk.
+#
+# usage: ./run_backpressure.sh [megabytes] [clients]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+MEGABYTES=${1:-40}
+CLIENTS=${2:-2}
+PORT=8100
+CONFIG_FILE="tests/benchmark/backpressure.conf"
+FAILED=0
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+if [[ ! -r /proc/self/status ]];
+then
+    echo "This script reads the peak RSS from /proc, please run it on Linux!"
+    exit 1
+fi
+
+peak_kb() {
+    awk '/^VmHWM/ { print $2 }' "/proc/$1/status"
+}
+
+printf "%-12s %8s %12s %10s %16s %8s\n" "buffer" "clients" "MB each" "MB/s" "peak growth (MB)" \
+    "result"
+for BUFFER in 256K 4M;
+do
+    {
+        echo "cgi_splice off;"
+        echo "cgi_output_buffer_size $BUFFER;"
+        echo "server {"
+        echo "    listen $PORT;"
+        echo "    location / {"
+        echo "        root ./tests/benchmark;"
+        echo "        cgi_pass py $(python3 -c "import sys; print(sys.executable)");"
+        echo "    }"
+        echo "}"
+    } > $CONFIG_FILE
+
+    ASAN_OPTIONS=quarantine_size_mb=0 $WEBSERV $CONFIG_FILE >/dev/null 2>&1 &
+    WEBSERV_PID=$!
+    sleep 1
+
+    # A first response warms up the buffers that every response uses
+    curl -s -o /dev/null "http://127.0.0.1:$PORT/cgi_payload.py?1"
+    PEAK_START=$(peak_kb $WEBSERV_PID)
+    RESULT=$(python3 - $PORT "$MEGABYTES" "$CLIENTS" <<'PYTHON'
+import socket, sys, threading, time
+port, megabytes, clients = int(sys.argv[1]), int(sys.argv[2]), int(sys.argv[3])
+received = []
+
+# Reads 64KB every 10ms, about 6MB/s, the CGI writes many times faster
+def client():
+    sock = socket.socket()
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 65536)
+    sock.connect(("127.0.0.1", port))
+    sock.sendall(b"GET /cgi_payload.py?%d HTTP/1.1\r\nHost: localhost\r\n"
+                 b"Connection: close\r\n\r\n" % megabytes)
+    total = 0
+    while True:
+        data = sock.recv(65536)
+        if not data:
+            break
+        total += len(data)
+        time.sleep(0.01)
+    received.append(total)
+
+threads = [threading.Thread(target=client) for _ in range(clients)]
+start = time.perf_counter()
+for thread in threads:
+    thread.start()
+for thread in threads:
+    thread.join()
+elapsed = time.perf_counter() - start
+# Headers and chunk sizes come on top of the payload
+complete = sum(total >= megabytes * 1048576 for total in received)
+print("%d %.1f" % (complete, sum(received) / 1048576 / elapsed))
+PYTHON
+)
+    read -r COMPLETE RATE <<< "$RESULT"
+    GROWTH=$((($(peak_kb $WEBSERV_PID) - PEAK_START) / 1024))
+
+    kill $WEBSERV_PID
+    wait $WEBSERV_PID 2>/dev/null
+
+    STATUS="ok"
+    if [[ $COMPLETE != "$CLIENTS" ]] || ((GROWTH * 2 > MEGABYTES));
+    then
+        STATUS="FAILED"
+        FAILED=1
+    fi
+    printf "%-12s %8s %12s %10s %16s %8s\n" "$BUFFER" "$CLIENTS" "$MEGABYTES" "$RATE" \
+        "$GROWTH" "$STATUS"
+done
+
+rm -f $CONFIG_FILE
+exit $FAILED
@@ -0,0 +1,49 @@
+#!/usr/bin/env bash
+
+# Measures the throughput of a webserv build with siege.
+# Run it on macOS (kqueue) and Linux (epoll) with the same arguments to compare the backends.
+# With NEW_CONNECTIONS=1 every request uses a new connection, measuring the connection rate.
+#
+# usage: [CONFIG=file] [NEW_CONNECTIONS=1] ./run_benchmark.sh [url] [concurrency] [duration]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+CONFIG=${CONFIG:-"./webserv.conf"}
+URL=${1:-"http://127.0.0.1:80/index.html"}
+CONCURRENCY=${2:-50}
+DURATION=${3:-"30S"}
+LOG_FILE="tests/benchmark/benchmark.log"
+
+SIEGE_ARGS=(-b -q -c "$CONCURRENCY" -t "$DURATION")
+if [[ $NEW_CONNECTIONS == 1 ]];
+then
+    SIEGE_ARGS+=(-H "Connection: close")
+fi
+
+if ! command -v siege >/dev/null 2>&1;
+then
+    echo "This script uses siege, please install it and try again!"
+    exit 1
+fi
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+$WEBSERV $CONFIG >/dev/null 2>&1 &
+WEBSERV_PID=$!
+sleep 1
+
+echo "backend:     $(uname -s)"
+echo "url:         $URL"
+echo "concurrency: $CONCURRENCY"
+echo "duration:    $DURATION"
+
+siege "${SIEGE_ARGS[@]}" "$URL" 2>&1 | tee $LOG_FILE \
+    | grep -E "Transactions|Transaction rate|Throughput|Failed transactions"
+
+kill $WEBSERV_PID
+wait $WEBSERV_PID 2>/dev/null
@@ -0,0 +1,135 @@
+#!/usr/bin/env bash
+
+# Checks cgi_pool against cgi_pass with the same application. A few requests check the answers,
+# parallel requests beyond the number of workers have to wait in line, and the pids of the workers
+# have to change once they served their maximum number of requests. Then both passes are loaded
+# with keep-alive requests and their rates are compared.
+#
+# usage: ./run_cgi_pool.sh [requests] [clients]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+REQUESTS=${1:-1000}
+CLIENTS=${2:-8}
+PORT=8099
+WORKERS=2
+MAX_REQUESTS=50
+ROOT="tests/benchmark/cgi_pool_root"
+CONFIG_FILE="tests/benchmark/cgi_pool.conf"
+FAILED=0
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+mkdir -p $ROOT
+cp tests/benchmark/fastcgi_app.py $ROOT/app.py
+{
+    echo "server {"
+    echo "    listen $PORT;"
+    echo "    location /cgi {"
+    echo "        root ./$ROOT;"
+    echo "        cgi_pass py $(python3 -c "import sys; print(sys.executable)");"
+    echo "    }"
+    echo "    location /pool {"
+    echo "        root ./$ROOT;"
+    echo "        cgi_pool py $(pwd)/$ROOT/app.py $WORKERS $MAX_REQUESTS;"
+    echo "        client_max_body_size 10M;"
+    echo "    }"
+    echo "}"
+} > $CONFIG_FILE
+
+$WEBSERV $CONFIG_FILE >/dev/null 2>&1 &
+WEBSERV_PID=$!
+sleep 1
+
+check() {
+    if [[ $2 == "$3" ]];
+    then
+        printf "%-40s %s\n" "$1" "ok"
+    else
+        printf "%-40s %s (expected %s, got %s)\n" "$1" "FAILED" "$3" "$2"
+        FAILED=1
+    fi
+}
+
+URL="http://127.0.0.1:$PORT/pool/app.py"
+head -c 3000000 /dev/urandom > $ROOT/body
+MD5=$(md5sum < $ROOT/body | cut -d' ' -f1)
+
+check "GET" "$(curl -s $URL | grep method=)" "method=GET"
+check "POST" "$(curl -s --data-binary @$ROOT/body $URL | grep md5=)" "md5=$MD5"
+check "chunked POST" "$(curl -s -H 'Transfer-Encoding: chunked' --data-binary @$ROOT/body $URL \
+    | grep md5=)" "md5=$MD5"
+
+# Slow uploads hold both workers, the requests behind them have to wait
+QUEUED=$(python3 - $PORT "$((WORKERS * 4))" <<'PYTHON'
+import http.client, sys, threading, time
+port, clients = int(sys.argv[1]), int(sys.argv[2])
+ok = []
+
+def client():
+    conn = http.client.HTTPConnection("127.0.0.1", port)
+    conn.putrequest("POST", "/pool/app.py")
+    conn.putheader("Content-Length", "4")
+    conn.endheaders()
+    for byte in b"slow":
+        time.sleep(0.1)
+        conn.send(bytes([byte]))
+    ok.append(b"length=4" in conn.getresponse().read())
+
+threads = [threading.Thread(target=client) for _ in range(clients)]
+for thread in threads:
+    thread.start()
+for thread in threads:
+    thread.join()
+print(sum(ok))
+PYTHON
+)
+check "queued requests answered" "$QUEUED" "$((WORKERS * 4))"
+
+PIDS=$(for ((i = 0; i < MAX_REQUESTS * WORKERS * 2; i++)); do curl -s $URL; echo; done \
+    | grep pid= | sort -u | wc -l)
+check "workers replaced after $MAX_REQUESTS requests" "$((PIDS > WORKERS))" "1"
+
+echo
+printf "%-8s %10s %10s %8s\n" "pass" "requests" "req/s" "result"
+for PASS in "cgi" "pool";
+do
+    RESULT=$(python3 - $PORT "$PASS" "$REQUESTS" "$CLIENTS" <<'PYTHON'
+import http.client, sys, threading, time
+port, path, requests, clients = int(sys.argv[1]), sys.argv[2], int(sys.argv[3]), int(sys.argv[4])
+ok = []
+
+def client(count):
+    conn = http.client.HTTPConnection("127.0.0.1", port)
+    for _ in range(count):
+        conn.request("POST", "/%s/app.py" % path, body=b"x" * 1000)
+        ok.append(b"length=1000" in conn.getresponse().read())
+
+threads = [threading.Thread(target=client, args=(requests // clients,)) for _ in range(clients)]
+start = time.perf_counter()
+for thread in threads:
+    thread.start()
+for thread in threads:
+    thread.join()
+print("%d %.0f" % (sum(ok), sum(ok) / (time.perf_counter() - start)))
+PYTHON
+)
+    read -r OK RATE <<< "$RESULT"
+    STATUS="ok"
+    if [[ $OK != "$((REQUESTS / CLIENTS * CLIENTS))" ]];
+    then
+        STATUS="FAILED"
+        FAILED=1
+    fi
+    printf "%-8s %10s %10s %8s\n" "$PASS" "$OK" "$RATE" "$STATUS"
+done
+
+kill $WEBSERV_PID
+wait $WEBSERV_PID 2>/dev/null
+rm -rf $ROOT $CONFIG_FILE
+exit $FAILED
@@ -0,0 +1,74 @@
+#!/usr/bin/env bash
+
+# Deletes files through the python delete_file.py CGI and natively with delete_files, over one
+# keep-alive connection each, checks that the files are gone and reports the deletes per second.
+#
+# usage: ./run_delete.sh [files]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+FILES=${1:-200}
+PORT=8094
+CONFIG_FILE="tests/benchmark/delete.conf"
+UPLOADS="data/html/upload/uploads"
+PREFIX="delete_bench_"
+FAILED=0
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+{
+    echo "server {"
+    echo "    listen $PORT;"
+    echo "    location / {"
+    echo "        root ./data/html;"
+    echo "        cgi_pass py /usr/bin/python3;"
+    echo "    }"
+    echo "    location /upload/uploads {"
+    echo "        root ./$UPLOADS;"
+    echo "        delete_files on;"
+    echo "    }"
+    echo "}"
+} > $CONFIG_FILE
+
+$WEBSERV $CONFIG_FILE >/dev/null 2>&1 &
+WEBSERV_PID=$!
+sleep 1
+mkdir -p $UPLOADS
+
+printf "%-16s %8s %10s %12s\n" "delete" "result" "time (s)" "deletes/s"
+for DELETE in "delete_file.py" "delete_files";
+do
+    for ((i = 0; i < FILES; i++)); do echo $i > "$UPLOADS/$PREFIX$i"; done
+    START=$(date +%s%N)
+    python3 - "$DELETE" $PORT $FILES $PREFIX <<'PYTHON'
+import http.client, sys
+delete, port, files, prefix = sys.argv[1], int(sys.argv[2]), int(sys.argv[3]), sys.argv[4]
+conn = http.client.HTTPConnection("127.0.0.1", port)
+for i in range(files):
+    if delete == "delete_file.py":
+        conn.request("DELETE", "/delete/delete_file.py", "filename=%s%d" % (prefix, i),
+                     {"Content-Type": "application/x-www-form-urlencoded"})
+    else:
+        conn.request("DELETE", "/upload/uploads/%s%d" % (prefix, i))
+    conn.getresponse().read()
+PYTHON
+    TIME=$(($(date +%s%N) - START))
+    STATUS="ok"
+    if compgen -G "$UPLOADS/$PREFIX*" > /dev/null;
+    then
+        STATUS="FAILED"
+        FAILED=1
+    fi
+    awk -v method="$DELETE" -v status="$STATUS" -v ns="$TIME" -v files="$FILES" \
+        'BEGIN { printf "%-16s %8s %10.2f %12.0f\n", method, status, ns / 1e9, files / (ns / 1e9) }'
+done
+
+kill $WEBSERV_PID
+wait $WEBSERV_PID 2>/dev/null
+rm -f $CONFIG_FILE "$UPLOADS/$PREFIX"*
+exit $FAILED
@@ -0,0 +1,119 @@
+#!/usr/bin/env bash
+
+# Sends requests to the same python app started per request with cgi_pass and running as a
+# FastCGI server behind fastcgi_pass, over a unix socket and TCP. Checks that bodies arrive whole,
+# that the FastCGI connections are reused and reports the requests per second.
+#
+# usage: ./run_fastcgi.sh [requests]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+REQUESTS=${1:-500}
+PORT=8096
+FASTCGI_PORT=8097
+FASTCGI_SOCKET="/tmp/webserv_fastcgi.$$.sock"
+APP="tests/benchmark/fastcgi_app.py"
+CONFIG_FILE="tests/benchmark/fastcgi.conf"
+URL="http://127.0.0.1:$PORT"
+FAILED=0
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+{
+    echo "fastcgi_keepalive 4;"
+    echo "server {"
+    echo "    listen $PORT;"
+    echo "    location /cgi {"
+    echo "        root ./tests/benchmark;"
+    echo "        cgi_pass py /usr/bin/python3;"
+    echo "    }"
+    echo "    location /unix {"
+    echo "        root ./tests/benchmark;"
+    echo "        fastcgi_pass py unix:$FASTCGI_SOCKET;"
+    echo "    }"
+    echo "    location /tcp {"
+    echo "        root ./tests/benchmark;"
+    echo "        fastcgi_pass py 127.0.0.1:$FASTCGI_PORT;"
+    echo "    }"
+    echo "}"
+} > $CONFIG_FILE
+
+python3 $APP "unix:$FASTCGI_SOCKET" &
+UNIX_PID=$!
+python3 $APP "127.0.0.1:$FASTCGI_PORT" &
+TCP_PID=$!
+$WEBSERV $CONFIG_FILE >/dev/null 2>&1 &
+WEBSERV_PID=$!
+sleep 1
+
+check() {
+    if [[ $2 == "$3" ]];
+    then
+        printf "%-44s ok\n" "$1"
+    else
+        printf "%-44s FAILED (expected %s, got %s)\n" "$1" "$3" "$2"
+        FAILED=1
+    fi
+}
+
+# Value of a line of the app output
+field() { grep "^$1=" | cut -d= -f2; }
+
+head -c 3000000 /dev/urandom > /tmp/fastcgi_body.$$
+BODY_MD5=$(md5sum < /tmp/fastcgi_body.$$ | cut -d" " -f1)
+for LOCATION in "unix" "tcp";
+do
+    check "$LOCATION GET" "$(curl -s "$URL/$LOCATION/fastcgi_app.py" | field method)" "GET"
+    check "$LOCATION POST of 3MB" "$(curl -s --data-binary @/tmp/fastcgi_body.$$ \
+        "$URL/$LOCATION/fastcgi_app.py" | field md5)" "$BODY_MD5"
+    check "$LOCATION chunked POST" "$(curl -s -H "Transfer-Encoding: chunked" \
+        --data-binary @/tmp/fastcgi_body.$$ "$URL/$LOCATION/fastcgi_app.py" | field md5)" \
+        "$BODY_MD5"
+done
+
+kill $UNIX_PID
+wait $UNIX_PID 2>/dev/null
+STATUS=$(curl -s -o /dev/null -w "%{http_code}" "$URL/unix/fastcgi_app.py")
+check "FastCGI server down" "$STATUS" "502"
+python3 $APP "unix:$FASTCGI_SOCKET" &
+UNIX_PID=$!
+sleep 1
+
+echo
+printf "%-8s %8s %12s %12s\n" "pass" "result" "connections" "requests/s"
+for LOCATION in "cgi" "unix" "tcp";
+do
+    START=$(date +%s%N)
+    RESULT=$(python3 - $PORT "/$LOCATION/fastcgi_app.py" "$REQUESTS" <<'PYTHON'
+import http.client, sys
+port, path, requests = int(sys.argv[1]), sys.argv[2], int(sys.argv[3])
+conn = http.client.HTTPConnection("127.0.0.1", port)
+lengths = 0
+for i in range(requests):
+    conn.request("POST", path, b"x" * i)
+    fields = dict(line.split("=") for line in conn.getresponse().read().decode().split())
+    lengths += int(fields["length"]) == i
+print(lengths, fields["connections"])
+PYTHON
+)
+    TIME=$(($(date +%s%N) - START))
+    STATUS="ok"
+    if [[ ${RESULT% *} != "$REQUESTS" ]];
+    then
+        STATUS="FAILED"
+        FAILED=1
+    fi
+    awk -v pass="$LOCATION" -v status="$STATUS" -v connections="${RESULT#* }" -v ns="$TIME" \
+        -v requests="$REQUESTS" \
+        'BEGIN { printf "%-8s %8s %12s %12.0f\n", pass, status, connections, requests / (ns / 1e9) }'
+done
+
+kill $WEBSERV_PID $UNIX_PID $TCP_PID
+wait $WEBSERV_PID $UNIX_PID $TCP_PID 2>/dev/null
+rm -f $CONFIG_FILE $FASTCGI_SOCKET /tmp/fastcgi_body.$$
+exit $FAILED
@@ -0,0 +1,70 @@
+#!/usr/bin/env bash
+
+# Compares gzip compression levels for a streamed CGI response: bytes on the wire against the CPU
+# time webserv spends on it. The CPU time is read from /proc, so this runs on Linux only.
+#
+# usage: ./run_gzip.sh [megabytes] [levels...]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+MEGABYTES=${1:-64}
+shift $(($# < 1 ? $# : 1))
+LEVELS=${*:-"off 1 6 9"}
+PORT=8087
+URL="http://127.0.0.1:$PORT/gzip_payload.py?$MEGABYTES"
+CONFIG_FILE="tests/benchmark/gzip.conf"
+CLK_TCK=$(getconf CLK_TCK)
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+if [[ ! -r /proc/self/stat ]];
+then
+    echo "This script reads the CPU time from /proc, please run it on Linux!"
+    exit 1
+fi
+
+cpu_ms() {
+    awk -v tck="$CLK_TCK" '{ print int(($14 + $15) * 1000 / tck) }' "/proc/$1/stat"
+}
+
+printf "%-6s %14s %8s %10s %12s\n" "level" "bytes sent" "ratio" "cpu (ms)" "cpu ms/MB"
+for LEVEL in $LEVELS;
+do
+    {
+        echo "server {"
+        echo "    listen $PORT;"
+        echo "    location / {"
+        echo "        root ./tests/benchmark;"
+        echo "        cgi_pass py /usr/bin/python3;"
+        if [[ $LEVEL != "off" ]];
+        then
+            echo "        gzip on;"
+            echo "        gzip_comp_level $LEVEL;"
+            echo "        gzip_types text/plain;"
+        fi
+        echo "    }"
+        echo "}"
+    } > $CONFIG_FILE
+
+    $WEBSERV $CONFIG_FILE >/dev/null 2>&1 &
+    WEBSERV_PID=$!
+    sleep 1
+
+    CPU_START=$(cpu_ms $WEBSERV_PID)
+    BYTES=$(curl -s -H "Accept-Encoding: gzip" -o /dev/null -w "%{size_download}" "$URL")
+    CPU=$(($(cpu_ms $WEBSERV_PID) - CPU_START))
+
+    kill $WEBSERV_PID
+    wait $WEBSERV_PID 2>/dev/null
+
+    awk -v level="$LEVEL" -v bytes="$BYTES" -v cpu="$CPU" -v mb="$MEGABYTES" 'BEGIN {
+        printf "%-6s %14d %7.1f%% %10d %12.1f\n", level, bytes, bytes * 100 / (mb * 1048576),
+            cpu, cpu / mb }'
+done
+
+rm -f $CONFIG_FILE
@@ -0,0 +1,81 @@
+#!/usr/bin/env bash
+
+# Requests the directory listing of a directory with a few files and of one with many files over
+# one keep-alive connection, checks that every file is listed and that a new file shows up right
+# away, and reports the requests per second.
+#
+# usage: ./run_listing.sh [requests]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+REQUESTS=${1:-200}
+PORT=8095
+ROOT="tests/benchmark/listing_root"
+CONFIG_FILE="tests/benchmark/listing.conf"
+FAILED=0
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+mkdir -p $ROOT/small $ROOT/large
+for ((i = 0; i < 20; i++)); do echo $i > "$ROOT/small/file_$i.txt"; done
+for ((i = 0; i < 2000; i++)); do echo $i > "$ROOT/large/file_$i.txt"; done
+# The cache only takes listings of directories that did not change within the last second
+sleep 1
+
+{
+    echo "server {"
+    echo "    listen $PORT;"
+    echo "    location / {"
+    echo "        root ./$ROOT;"
+    echo "        directory_listing on;"
+    echo "    }"
+    echo "}"
+} > $CONFIG_FILE
+
+$WEBSERV $CONFIG_FILE >/dev/null 2>&1 &
+WEBSERV_PID=$!
+sleep 1
+
+printf "%-12s %8s %8s %12s\n" "directory" "files" "result" "requests/s"
+for DIRECTORY in "small" "large";
+do
+    FILES=$(find "$ROOT/$DIRECTORY" -type f | wc -l)
+    START=$(date +%s%N)
+    LISTED=$(python3 - $PORT "/$DIRECTORY/" "$REQUESTS" <<'PYTHON'
+import http.client, sys
+port, path, requests = int(sys.argv[1]), sys.argv[2], int(sys.argv[3])
+conn = http.client.HTTPConnection("127.0.0.1", port)
+for i in range(requests):
+    conn.request("GET", path)
+    body = conn.getresponse().read()
+print(body.count(b"<td>File</td>"))
+PYTHON
+)
+    TIME=$(($(date +%s%N) - START))
+    STATUS="ok"
+    if [[ $LISTED != "$FILES" ]];
+    then
+        STATUS="FAILED"
+        FAILED=1
+    fi
+    awk -v directory="$DIRECTORY" -v files="$FILES" -v status="$STATUS" -v ns="$TIME" \
+        -v requests="$REQUESTS" \
+        'BEGIN { printf "%-12s %8d %8s %12.0f\n", directory, files, status, requests / (ns / 1e9) }'
+done
+
+echo new > "$ROOT/small/new_file.txt"
+if ! curl -s "http://127.0.0.1:$PORT/small/" | grep -q "new_file.txt";
+then
+    echo "new file not listed: FAILED"
+    FAILED=1
+fi
+
+kill $WEBSERV_PID
+wait $WEBSERV_PID 2>/dev/null
+rm -rf $ROOT $CONFIG_FILE
+exit $FAILED
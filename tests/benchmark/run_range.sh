@@ -0,0 +1,133 @@
+#!/usr/bin/env bash
+
+# Checks Range requests against a sparse file of a few GB with marker bytes near its end, so a
+# wrong offset shows up as zeros, and reports how long a seek to the end takes.
+#
+# usage: ./run_range.sh [gigabytes]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+GIGABYTES=${1:-4}
+PORT=8088
+ROOT="tests/benchmark/range_root"
+CONFIG_FILE="tests/benchmark/range.conf"
+BIG="$ROOT/sparse.bin"
+SMALL="$ROOT/small.txt"
+URL="http://127.0.0.1:$PORT"
+FAILED=0
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+mkdir -p $ROOT
+truncate -s "${GIGABYTES}G" $BIG
+SIZE=$(stat -c %s $BIG)
+for OFFSET in $((SIZE - 3000000)) $((SIZE - 1048576)) $((SIZE - 100));
+do
+    printf "marker at %d" $OFFSET | dd of=$BIG bs=1 seek=$OFFSET conv=notrunc status=none
+done
+seq 1 2000 > $SMALL
+SMALL_SIZE=$(stat -c %s $SMALL)
+LAST_MODIFIED=$(date -u -r $SMALL "+%a, %d %b %Y %H:%M:%S GMT")
+
+{
+    echo "server {"
+    echo "    listen $PORT;"
+    echo "    location / {"
+    echo "        root ./$ROOT;"
+    echo "    }"
+    echo "}"
+} > $CONFIG_FILE
+
+$WEBSERV $CONFIG_FILE >/dev/null 2>&1 &
+WEBSERV_PID=$!
+sleep 1
+
+check() {
+    if [[ $2 == "$3" ]];
+    then
+        printf "%-44s ok\n" "$1"
+    else
+        printf "%-44s FAILED (expected %s, got %s)\n" "$1" "$3" "$2"
+        FAILED=1
+    fi
+}
+
+# md5 of the bytes first to last of a file, read with dd to compare against
+slice_md5() {
+    dd if="$1" bs=65536 skip="$2" count=$(($3 - $2 + 1)) iflag=skip_bytes,count_bytes status=none |
+        md5sum | cut -d" " -f1
+}
+
+# md5 of the body of a ranged GET, the header is kept for status() and header()
+fetch() {
+    curl -s -D /tmp/range_header.$$ -H "Range: $2" "${@:3}" "$URL/$1" | md5sum | cut -d" " -f1
+}
+
+status() { head -1 /tmp/range_header.$$ | cut -d" " -f2; }
+
+header() { grep -i "^$1:" /tmp/range_header.$$ | cut -d" " -f2- | tr -d "\r"; }
+
+FIRST=$((SIZE - 3000010))
+LAST=$((SIZE - 2999000))
+MD5=$(fetch sparse.bin "bytes=$FIRST-$LAST")
+check "single range near the end" "$(status) $MD5" "206 $(slice_md5 $BIG $FIRST $LAST)"
+check "  Content-Range" "$(header Content-Range)" "bytes $FIRST-$LAST/$SIZE"
+check "  Content-Length" "$(header Content-Length)" "$((LAST - FIRST + 1))"
+
+MD5=$(fetch sparse.bin "bytes=-1000")
+check "suffix range" "$(status) $MD5" "206 $(slice_md5 $BIG $((SIZE - 1000)) $((SIZE - 1)))"
+
+FIRST=$((SIZE - 1048576))
+MD5=$(fetch sparse.bin "bytes=$FIRST-")
+check "open range of the last MB" "$(status) $MD5" "206 $(slice_md5 $BIG $FIRST $((SIZE - 1)))"
+
+MD5=$(fetch sparse.bin "bytes=$SIZE-")
+check "range past the end" "$(status) $(header Content-Range)" "416 bytes */$SIZE"
+
+curl -s -I "$URL/sparse.bin" > /tmp/range_header.$$
+check "whole file announces ranges" "$(status) $(header Accept-Ranges)" "200 bytes"
+check "  Content-Length" "$(header Content-Length)" "$SIZE"
+
+# Two ranges come back as multipart/byteranges, the parts are cut out of the body again
+curl -s -D /tmp/range_header.$$ -H "Range: bytes=0-9,$((SMALL_SIZE - 10))-" \
+    -o /tmp/range_body.$$ "$URL/small.txt"
+check "multiple ranges" "$(status) $(header Content-Type | cut -d";" -f1)" \
+    "206 multipart/byteranges"
+check "  Content-Length" "$(header Content-Length)" "$(stat -c %s /tmp/range_body.$$)"
+PARTS=$(python3 -c '
+import email, sys
+body = open(sys.argv[1], "rb").read()
+msg = email.message_from_bytes(b"Content-Type: " + sys.argv[2].encode() + b"\r\n\r\n" + body)
+parts = msg.get_payload()
+print(" ".join(p["Content-Range"] + "=" + str(len(p.get_payload(decode=True))) for p in parts))
+' /tmp/range_body.$$ "$(header Content-Type)")
+check "  parts" "$PARTS" \
+    "bytes 0-9/$SMALL_SIZE=10 bytes $((SMALL_SIZE - 10))-$((SMALL_SIZE - 1))/$SMALL_SIZE=10"
+
+fetch small.txt "bytes=100-199" -H "If-Range: $LAST_MODIFIED" > /dev/null
+check "If-Range with the current date" "$(status)" "206"
+fetch small.txt "bytes=100-199" -H "If-Range: Thu, 01 Jan 1970 00:00:00 GMT" > /dev/null
+check "If-Range with an old date" "$(status) $(header Content-Length)" "200 $SMALL_SIZE"
+
+fetch small.txt "bytes=0-9,5-14" > /dev/null
+check "overlapping ranges within the file size" "$(status)" "206"
+fetch small.txt "bytes=0-,0-" > /dev/null
+check "overlapping ranges beyond the file size" "$(status)" "200"
+
+# A resumed download put together from two ranges matches the file
+{ curl -s -r 0-4999 "$URL/small.txt"; curl -s -r 5000- "$URL/small.txt"; } > /tmp/range_body.$$
+check "resumed download" "$(md5sum < /tmp/range_body.$$)" "$(md5sum < $SMALL)"
+
+TIME=$(curl -s -o /dev/null -r "$((SIZE - 1048576))-" -w "%{time_total}" "$URL/sparse.bin")
+echo
+echo "last MB of a ${GIGABYTES}GB file: ${TIME}s"
+
+kill $WEBSERV_PID
+wait $WEBSERV_PID 2>/dev/null
+rm -rf $ROOT $CONFIG_FILE /tmp/range_header.$$ /tmp/range_body.$$
+exit $FAILED
@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+
+# Measures how the throughput scales with the value of a numeric top-level directive.
+# Runs run_benchmark.sh once per value with a copy of webserv.conf.
+# DIRECTIVE defaults to worker_processes, worker_threads and multi_accept work the same way.
+#
+# usage: [DIRECTIVE=name] ./run_scaling.sh [url] [concurrency] [duration] [values...]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+URL=${1:-"http://127.0.0.1:80/index.html"}
+CONCURRENCY=${2:-200}
+DURATION=${3:-"30S"}
+shift $(($# < 3 ? $# : 3))
+VALUES=${*:-"1 2 4 8"}
+DIRECTIVE=${DIRECTIVE:-"worker_processes"}
+CONFIG_FILE="tests/benchmark/scaling.conf"
+
+for VALUE in $VALUES;
+do
+    grep -v "^$DIRECTIVE" webserv.conf > $CONFIG_FILE
+    echo "$DIRECTIVE $VALUE;" >> $CONFIG_FILE
+
+    echo "$DIRECTIVE: $VALUE"
+    CONFIG=$CONFIG_FILE ./tests/benchmark/run_benchmark.sh "$URL" "$CONCURRENCY" "$DURATION" \
+        | grep -E "Transaction rate|Failed transactions"
+    echo
+done
+
+rm -f $CONFIG_FILE
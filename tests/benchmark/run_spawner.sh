@@ -0,0 +1,106 @@
+#!/usr/bin/env bash
+
+# Measures how long CGI launches stall the event loop, with CGIs forked from the server and
+# launched by the spawner. The server first fills its response cache, so forking it has the page
+# tables of that memory to copy. One client then starts CGIs over and over while another one
+# requests a small static file and records how long each request takes, a stall of the loop shows
+# up in the tail of those latencies. Also counts the CGIs left unreaped.
+#
+# usage: ./run_spawner.sh [cgi requests] [cached MB, at most 60]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+REQUESTS=${1:-300}
+CACHED_MB=${2:-60}
+PORT=8098
+ROOT="tests/benchmark/spawner_root"
+CONFIG_FILE="tests/benchmark/spawner.conf"
+FAILED=0
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+mkdir -p $ROOT/cache
+FILES=$((CACHED_MB * 16))
+for ((i = 0; i < FILES; i++)); do head -c 65000 /dev/zero > "$ROOT/cache/$i"; done
+echo small > $ROOT/small.txt
+printf 'echo "Content-Type: text/plain"\necho\necho spawned\n' > $ROOT/spawn.sh
+
+printf "%-8s %10s %10s %10s %10s %10s %8s\n" "spawner" "cgi/s" "p50 (ms)" "p99 (ms)" \
+    "max (ms)" "zombies" "result"
+for SPAWNER in "off" "on";
+do
+    {
+        echo "cgi_spawner $SPAWNER;"
+        echo "response_cache_entries $FILES;"
+        echo "response_cache_size $((CACHED_MB + 4))M;"
+        echo "server {"
+        echo "    listen $PORT;"
+        echo "    location / {"
+        echo "        root ./$ROOT;"
+        echo "        cgi_pass sh /bin/sh;"
+        echo "    }"
+        echo "}"
+    } > $CONFIG_FILE
+
+    $WEBSERV $CONFIG_FILE >/dev/null 2>&1 &
+    WEBSERV_PID=$!
+    sleep 1
+
+    RESULT=$(python3 - $PORT "$REQUESTS" "$FILES" <<'PYTHON'
+import http.client, sys, threading, time
+port, requests, files = int(sys.argv[1]), int(sys.argv[2]), int(sys.argv[3])
+
+conn = http.client.HTTPConnection("127.0.0.1", port)
+for i in range(files):
+    conn.request("GET", "/cache/%d" % i)
+    conn.getresponse().read()
+
+latencies, running, spawned = [], True, [0]
+
+def probe():
+    conn = http.client.HTTPConnection("127.0.0.1", port)
+    while running:
+        start = time.perf_counter()
+        conn.request("GET", "/small.txt")
+        conn.getresponse().read()
+        latencies.append(time.perf_counter() - start)
+
+thread = threading.Thread(target=probe)
+thread.start()
+start = time.perf_counter()
+for i in range(requests):
+    conn.request("GET", "/spawn.sh")
+    spawned[0] += conn.getresponse().read() == b"spawned\n"
+elapsed = time.perf_counter() - start
+running = False
+thread.join()
+latencies.sort()
+print("%d %.0f %.2f %.2f %.2f" % (spawned[0], requests / elapsed,
+      latencies[len(latencies) // 2] * 1000, latencies[len(latencies) * 99 // 100] * 1000,
+      latencies[-1] * 1000))
+PYTHON
+)
+    read -r SPAWNED CGI_RATE P50 P99 MAX <<< "$RESULT"
+    ZOMBIES=$(ps -eo ppid=,stat= | awk -v pids="$(pgrep -d' ' webserv)" \
+        'BEGIN { n = split(pids, p, " "); for (i = 1; i <= n; i++) own[p[i]] = 1 }
+         $2 ~ /^Z/ && own[$1] { count++ } END { print count + 0 }')
+    STATUS="ok"
+    if [[ $SPAWNED != "$REQUESTS" ]] || { [[ $SPAWNER == "on" ]] && [[ $ZOMBIES != 0 ]]; };
+    then
+        STATUS="FAILED"
+        FAILED=1
+    fi
+    printf "%-8s %10s %10s %10s %10s %10s %8s\n" "$SPAWNER" "$CGI_RATE" "$P50" "$P99" "$MAX" \
+        "$ZOMBIES" "$STATUS"
+
+    kill $WEBSERV_PID
+    wait $WEBSERV_PID 2>/dev/null
+done
+
+rm -rf $ROOT $CONFIG_FILE
+exit $FAILED
@@ -0,0 +1,70 @@
+#!/usr/bin/env bash
+
+# Compares the CPU time webserv spends forwarding a large CGI response with cgi_splice on and off.
+# The CPU time is read from /proc, so this runs on Linux only.
+#
+# usage: ./run_splice.sh [megabytes] [runs]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+MEGABYTES=${1:-256}
+RUNS=${2:-3}
+PORT=8089
+URL="http://127.0.0.1:$PORT/cgi_payload.py?$MEGABYTES"
+CONFIG_FILE="tests/benchmark/splice.conf"
+CLK_TCK=$(getconf CLK_TCK)
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+if [[ ! -r /proc/self/stat ]];
+then
+    echo "This script reads the CPU time from /proc, please run it on Linux!"
+    exit 1
+fi
+
+cpu_ms() {
+    awk -v tck="$CLK_TCK" '{ print int(($14 + $15) * 1000 / tck) }' "/proc/$1/stat"
+}
+
+printf "%-10s %12s %10s %12s %10s\n" "cgi_splice" "bytes" "cpu (ms)" "cpu ms/MB" "MB/s"
+for SPLICE in off on;
+do
+    {
+        echo "cgi_splice $SPLICE;"
+        echo "server {"
+        echo "    listen $PORT;"
+        echo "    location / {"
+        echo "        root ./tests/benchmark;"
+        echo "        cgi_pass py /usr/bin/python3;"
+        echo "    }"
+        echo "}"
+    } > $CONFIG_FILE
+
+    $WEBSERV $CONFIG_FILE >/dev/null 2>&1 &
+    WEBSERV_PID=$!
+    sleep 1
+
+    CPU_START=$(cpu_ms $WEBSERV_PID)
+    START=$(date +%s%N)
+    BYTES=0
+    for ((i = 0; i < RUNS; i++));
+    do
+        BYTES=$((BYTES + $(curl -s -o /dev/null -w "%{size_download}" "$URL")))
+    done
+    TIME=$(($(date +%s%N) - START))
+    CPU=$(($(cpu_ms $WEBSERV_PID) - CPU_START))
+
+    kill $WEBSERV_PID
+    wait $WEBSERV_PID 2>/dev/null
+
+    awk -v splice="$SPLICE" -v bytes="$BYTES" -v cpu="$CPU" -v ns="$TIME" 'BEGIN {
+        mb = bytes / 1048576
+        printf "%-10s %12d %10d %12.2f %10.1f\n", splice, bytes, cpu, cpu / mb, mb * 1e9 / ns }'
+done
+
+rm -f $CONFIG_FILE
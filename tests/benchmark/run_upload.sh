@@ -0,0 +1,84 @@
+#!/usr/bin/env bash
+
+# Uploads a file of random bytes to a CGI with a Content-Length and chunked, streamed and spooled
+# to a temp file, checks the md5 the CGI reports and shows how much the peak memory of webserv
+# grew. The peak is read from /proc, so this runs on Linux only.
+#
+# usage: ./run_upload.sh [megabytes] [cgi delay per 64KB in ms]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+MEGABYTES=${1:-60}
+DELAY=${2:-1}
+PORT=8090
+URL="http://127.0.0.1:$PORT"
+CONFIG_FILE="tests/benchmark/upload.conf"
+UPLOAD_FILE="tests/benchmark/upload.bin"
+FAILED=0
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+if [[ ! -r /proc/self/status ]];
+then
+    echo "This script reads the peak memory from /proc, please run it on Linux!"
+    exit 1
+fi
+
+{
+    echo "server {"
+    echo "    listen $PORT;"
+    echo "    location / {"
+    echo "        root ./tests/benchmark;"
+    echo "        client_max_body_size 64M;"
+    echo "        cgi_pass py /usr/bin/python3;"
+    echo "    }"
+    echo "    location /spooled {"
+    echo "        root ./tests/benchmark;"
+    echo "        client_max_body_size 64M;"
+    echo "        client_body_buffer_size 16K;"
+    echo "        cgi_pass py /usr/bin/python3;"
+    echo "    }"
+    echo "}"
+} > $CONFIG_FILE
+
+head -c "${MEGABYTES}M" /dev/urandom > $UPLOAD_FILE
+EXPECTED="$(stat -c %s $UPLOAD_FILE) $(md5sum < $UPLOAD_FILE | cut -d" " -f1)"
+
+$WEBSERV $CONFIG_FILE >/dev/null 2>&1 &
+WEBSERV_PID=$!
+sleep 1
+
+peak_kb() { awk '/^VmHWM/ { print $2 }' "/proc/$1/status"; }
+
+printf "%-16s %8s %10s %16s\n" "body" "result" "time (s)" "peak growth (kB)"
+for BODY in "length" "chunked" "length spooled" "chunked spooled";
+do
+    HEADER="X-Body: length"
+    [[ $BODY == chunked* ]] && HEADER="Transfer-Encoding: chunked"
+    LOCATION=""
+    [[ $BODY == *spooled ]] && LOCATION="/spooled"
+    PEAK_START=$(peak_kb $WEBSERV_PID)
+    START=$(date +%s%N)
+    RESULT=$(curl -s -H "$HEADER" --data-binary @$UPLOAD_FILE \
+        "$URL$LOCATION/upload_payload.py?$DELAY")
+    TIME=$(($(date +%s%N) - START))
+    STATUS="ok"
+    if [[ $RESULT != "$EXPECTED" ]];
+    then
+        STATUS="FAILED"
+        FAILED=1
+    fi
+    awk -v body="$BODY" -v status="$STATUS" -v ns="$TIME" \
+        -v peak="$(($(peak_kb $WEBSERV_PID) - PEAK_START))" \
+        'BEGIN { printf "%-16s %8s %10.2f %16d\n", body, status, ns / 1e9, peak }'
+done
+
+kill $WEBSERV_PID
+wait $WEBSERV_PID 2>/dev/null
+rm -f $CONFIG_FILE $UPLOAD_FILE
+exit $FAILED
@@ -0,0 +1,118 @@
+#!/usr/bin/env bash
+
+# Uploads a file of random bytes as multipart/form-data to the python save_file.py CGI and to a
+# location with upload_store, and once more with PUT, checks the md5 of the stored files and shows
+# the time, the throughput and how much the peak memory of webserv and of the CGI grew. A PUT into
+# a subdirectory of the store has to be rejected. The peaks are read from /proc and getrusage, so
+# this runs on Linux only.
+#
+# usage: ./run_upload_store.sh [megabytes]
+
+cd "$(dirname "$0")/../.." || exit 1
+
+WEBSERV="./build/webserv"
+MEGABYTES=${1:-32}
+PORT=8091
+URL="http://127.0.0.1:$PORT"
+CONFIG_FILE="tests/benchmark/upload_store.conf"
+UPLOAD_FILE="tests/benchmark/upload_store.bin"
+STORE="tests/benchmark/upload_store"
+CGI_STORE="data/html/upload/uploads"
+PYTHON_RSS="tests/benchmark/python_rss.py"
+RSS_REPORT="/tmp/upload_store_rss.$$"
+FAILED=0
+
+if [[ ! -x $WEBSERV ]];
+then
+    echo "No webserv binary found, build it with make first!"
+    exit 1
+fi
+
+if [[ ! -r /proc/self/status ]];
+then
+    echo "This script reads the peak memory from /proc, please run it on Linux!"
+    exit 1
+fi
+
+# Runs the CGI like python3 does and reports the peak memory of it
+{
+    echo "#!/usr/bin/python3"
+    echo "import resource, subprocess, sys"
+    echo "code = subprocess.call(['/usr/bin/python3'] + sys.argv[1:])"
+    echo "with open('$RSS_REPORT', 'w') as report:"
+    echo "    report.write(str(resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss))"
+    echo "sys.exit(code)"
+} > $PYTHON_RSS
+chmod +x $PYTHON_RSS
+
+{
+    echo "server {"
+    echo "    listen $PORT;"
+    echo "    client_max_body_size 64M;"
+    echo "    location /upload {"
+    echo "        root ./data/html/upload;"
+    echo "        cgi_pass py $(pwd)/$PYTHON_RSS;"
+    echo "    }"
+    echo "    location /native {"
+    echo "        root ./$STORE;"
+    echo "        accepted_methods POST PUT;"
+    echo "        upload_store ./$STORE;"
+    echo "    }"
+    echo "}"
+} > $CONFIG_FILE
+
+head -c "${MEGABYTES}M" /dev/urandom > $UPLOAD_FILE
+EXPECTED=$(md5sum < $UPLOAD_FILE | cut -d" " -f1)
+NAME=$(basename $UPLOAD_FILE)
+
+$WEBSERV $CONFIG_FILE >/dev/null 2>&1 &
+WEBSERV_PID=$!
+sleep 1
+
+peak_kb() { awk '/^VmHWM/ { print $2 }' "/proc/$1/status"; }
+
+printf "%-20s %8s %10s %8s %16s %12s\n" "upload" "result" "time (s)" "MB/s" "peak growth (kB)" \
+    "cgi peak (kB)"
+for UPLOAD in "save_file.py" "upload_store" "upload_store PUT";
+do
+    rm -f $RSS_REPORT
+    PEAK_START=$(peak_kb $WEBSERV_PID)
+    START=$(date +%s%N)
+    case $UPLOAD in
+        "save_file.py")
+            curl -s -o /dev/null -F "filename=@$UPLOAD_FILE" "$URL/upload/save_file.py"
+            STORED="$CGI_STORE/$NAME" ;;
+        "upload_store")
+            curl -s -o /dev/null -F "filename=@$UPLOAD_FILE" "$URL/native/"
+            STORED="$STORE/$NAME" ;;
+        *)
+            curl -s -o /dev/null -T $UPLOAD_FILE "$URL/native/put.bin"
+            STORED="$STORE/put.bin" ;;
+    esac
+    TIME=$(($(date +%s%N) - START))
+    STATUS="ok"
+    if [[ ! -f $STORED || $(md5sum < "$STORED" | cut -d" " -f1) != "$EXPECTED" ]];
+    then
+        STATUS="FAILED"
+        FAILED=1
+    fi
+    CGI_PEAK="-"
+    [[ -f $RSS_REPORT ]] && CGI_PEAK=$(cat $RSS_REPORT)
+    rm -f "$STORED"
+    awk -v upload="$UPLOAD" -v status="$STATUS" -v ns="$TIME" -v cgi_peak="$CGI_PEAK" \
+        -v peak="$(($(peak_kb $WEBSERV_PID) - PEAK_START))" -v mb="$MEGABYTES" \
+        'BEGIN { printf "%-20s %8s %10.2f %8.1f %16d %12s\n", upload, status, ns / 1e9,
+                 mb * 1e9 / ns, peak, cgi_peak }'
+done
+
+CODE=$(curl -s -o /dev/null -w "%{http_code}" -T $UPLOAD_FILE "$URL/native/sub/put.bin")
+if [[ $CODE != "409" || -e $STORE/sub ]];
+then
+    echo "PUT into a subdirectory: FAILED (expected 409, got $CODE)"
+    FAILED=1
+fi
+
+kill $WEBSERV_PID
+wait $WEBSERV_PID 2>/dev/null
+rm -rf $CONFIG_FILE $UPLOAD_FILE $STORE $PYTHON_RSS $RSS_REPORT
+exit $FAILED
@@ -0,0 +1,24 @@
+#!/usr/bin/python3
+
+# Reads the request body to its end and answers with its length and md5, so a test can tell
+# that nothing was lost on the way. A QUERY_STRING of milliseconds slows down every 64KB read.
+
+import hashlib
+import os
+import sys
+import time
+
+delay = int(os.environ.get("QUERY_STRING") or "0") / 1000
+md5 = hashlib.md5()
+length = 0
+
+while True:
+    block = os.read(0, 65536)
+    if not block:
+        break
+    md5.update(block)
+    length += len(block)
+    if delay:
+        time.sleep(delay)
+
+sys.stdout.write("Content-Type: text/plain\r\n\r\n%d %s\n" % (length, md5.hexdigest()))